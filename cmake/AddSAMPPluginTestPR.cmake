@@ -46,4 +46,11 @@ function(add_samp_plugin_test)
     set_tests_properties(${name} PROPERTIES
                          WORKING_DIRECTORY ${ARG_WORKING_DIRECTORY})
   endif()
+
+  if(ARG_CONFIG)
+    if(NOT ARG_WORKING_DIRECTORY)
+      message(FATAL_ERROR "CONFIG argument requires WORKING_DIRECTORY")
+    endif()
+    configure_file(${ARG_CONFIG} ${ARG_WORKING_DIRECTORY}/server.cfg COPYONLY)
+  endif()
 endfunction()
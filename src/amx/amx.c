@@ -75,12 +75,22 @@
   #include <windows.h>
 #endif
 
+#if defined _MSC_VER
+  #define AMX_THREAD_LOCAL __declspec(thread)
+#else
+  #define AMX_THREAD_LOCAL __thread
+#endif
+
 /* CheckLongCallTime uses the values in `amx`, but while we're in `Exec`
  * they aren't accurate.
+ *
+ * The instruction counter is per thread so that scripts executed from other
+ * threads don't trigger each other's checks. amx_Exec() looks it up once and
+ * then only goes through the `long_call_delay` pointer.
  */
-static unsigned int long_call_delay=0;
-static void checkLongCallTime(AMX *amx, AMX_LCT_CTL long_call_ctl, cell frm, cell hea, cell stk) {
-  if (long_call_delay>=5000) {
+static AMX_THREAD_LOCAL unsigned int thread_long_call_delay=0;
+static void checkLongCallTime(AMX *amx, AMX_LCT_CTL long_call_ctl, unsigned int *long_call_delay, cell frm, cell hea, cell stk) {
+  if (*long_call_delay>=5000) {
     if (long_call_ctl!=NULL) {
       cell tmp_frm=amx->frm;
       cell tmp_hea=amx->hea;
@@ -93,11 +103,11 @@ static void checkLongCallTime(AMX *amx, AMX_LCT_CTL long_call_ctl, cell frm, cel
       amx->hea=tmp_hea;
       amx->stk=tmp_stk;
     }
-    long_call_delay=0;
+    *long_call_delay=0;
   }
 }
 
-#define CHECK_LONG_CALL_TIME() (++long_call_delay)
+#define CHECK_LONG_CALL_TIME() (++*long_call_delay)
 
 /* When one or more of the AMX_funcname macris are defined, we want
  * to compile only those functions. However, when none of these macros
@@ -1797,6 +1807,7 @@ static const void * const amx_opcodelist[] = {
   int num,i;
   AMX_EXT_HOOKS *ext_hooks=NULL;
   AMX_LCT_CTL long_call_ctl=NULL;
+  unsigned int *long_call_delay=&thread_long_call_delay;
   AMX_ADDR_0_CTL address_naught_ctl=NULL;
 
   /* HACK: return label table (for amx_BrowseRelocate) if amx structure
@@ -2712,7 +2723,7 @@ static const void * const amx_opcodelist[] = {
   op_break:
     if (amx->debug!=NULL) {
       /* only checked at the ends of statements */
-      checkLongCallTime(amx, long_call_ctl, frm, hea, stk);
+      checkLongCallTime(amx, long_call_ctl, long_call_delay, frm, hea, stk);
       /* store status */
       amx->frm=frm;
       amx->stk=stk;
@@ -2797,6 +2808,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
   #endif
   AMX_EXT_HOOKS *ext_hooks=NULL;
   AMX_LCT_CTL long_call_ctl=NULL;
+  unsigned int *long_call_delay=&thread_long_call_delay;
   AMX_ADDR_0_CTL address_naught_ctl=NULL;
 
   assert(amx!=NULL);
@@ -3761,7 +3773,7 @@ int AMXAPI amx_Exec(AMX *amx, cell *retval, int index)
       assert((amx->flags & AMX_FLAG_BROWSE)==0);
       if (amx->debug!=NULL) {
         /* only checked at the ends of statements */
-        checkLongCallTime(amx, long_call_ctl, frm, hea, stk);
+        checkLongCallTime(amx, long_call_ctl, long_call_delay, frm, hea, stk);
         /* store status */
         amx->frm=frm;
         amx->stk=stk;
@@ -25,6 +25,15 @@
 #include <cassert>
 #include "amxcallstack.h"
 
+AMXCall::AMXCall()
+ : amx_(nullptr),
+   type_(PUBLIC),
+   frm_(0),
+   cip_(0),
+   index_(0)
+{
+}
+
 AMXCall::AMXCall(Type type, AMXRef amx, cell index)
  : amx_(amx),
    type_(type),
@@ -53,27 +62,49 @@ AMXCall AMXCall::Native(AMXRef amx, cell index) {
   return AMXCall(NATIVE, amx, index);
 }
 
+AMXCallStack::AMXCallStack()
+ : snapshot_depth_(0)
+{
+  call_stack_.reserve(kInitialCapacity);
+}
+
 bool AMXCallStack::IsEmpty() const {
   return call_stack_.empty();
 }
 
 AMXCall &AMXCallStack::Top() {
   assert(!IsEmpty());
-  return call_stack_.top();
+  return call_stack_.back();
 }
 
 const AMXCall &AMXCallStack::Top() const {
   assert(!IsEmpty());
-  return call_stack_.top();
+  return call_stack_.back();
+}
+
+const AMXCall &AMXCallStack::operator[](std::size_t index) const {
+  assert(index < call_stack_.size());
+  return call_stack_[index];
 }
 
 void AMXCallStack::Push(AMXCall call) {
-  call_stack_.push(call);
+  std::size_t depth = call_stack_.size();
+  if (depth < kMaxSnapshotSize) {
+    snapshot_[depth] = call;
+  }
+  call_stack_.push_back(call);
+  snapshot_depth_.store(depth + 1, std::memory_order_release);
 }
 
 AMXCall AMXCallStack::Pop() {
   assert(!IsEmpty());
-  AMXCall result = call_stack_.top();
-  call_stack_.pop();
+  snapshot_depth_.store(call_stack_.size() - 1, std::memory_order_release);
+  AMXCall result = call_stack_.back();
+  call_stack_.pop_back();
   return result;
 }
+
+std::size_t AMXCallStack::GetSnapshot(const AMXCall *&calls) const {
+  calls = snapshot_;
+  return snapshot_depth_.load(std::memory_order_acquire);
+}
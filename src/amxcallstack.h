@@ -25,7 +25,9 @@
 #ifndef AMXCALLSTACK_H
 #define AMXCALLSTACK_H
 
-#include <stack>
+#include <atomic>
+#include <cstddef>
+#include <vector>
 #include "amxref.h"
 
 class AMXCall {
@@ -35,6 +37,7 @@ class AMXCall {
     PUBLIC
   };
 
+  AMXCall();
   AMXCall(Type type, AMXRef amx, cell index);
   AMXCall(Type type, AMXRef amx, cell index, cell frm, cell cip);
 
@@ -59,18 +62,43 @@ class AMXCall {
   cell index_;
 };
 
+// Calls are kept in a contiguous array that is reserved up front and only
+// grows (geometrically) when a script nests deeper than that. The const
+// interface is an indexable view of the stack, 0 being the bottom, so the
+// backtrace code can walk it without making a copy.
+//
+// A signal handler can't use that view since the array may be reallocated
+// under its feet. Instead, the bottom kMaxSnapshotSize calls are copied to
+// a fixed-size array as well, and its depth is updated only after a call
+// has been written there.
 class AMXCallStack {
  public:
+  static const std::size_t kMaxSnapshotSize = 256;
+
+  AMXCallStack();
+
   bool IsEmpty() const;
+  std::size_t size() const { return call_stack_.size(); }
 
   AMXCall &Top();
   const AMXCall &Top() const;
 
+  const AMXCall &operator[](std::size_t index) const;
+
   void Push(AMXCall call);
   AMXCall Pop();
 
+  // Can be called from a signal handler running on the thread that owns the
+  // stack. Returns the depth of the stack, which may be more than the
+  // number of calls in the snapshot (kMaxSnapshotSize at most).
+  std::size_t GetSnapshot(const AMXCall *&calls) const;
+
  private:
-  std::stack<AMXCall> call_stack_;
+  static const std::size_t kInitialCapacity = 256;
+
+  std::vector<AMXCall> call_stack_;
+  AMXCall snapshot_[kMaxSnapshotSize];
+  std::atomic<std::size_t> snapshot_depth_;
 };
 
 #endif // !AMXCALLSTACK_H
@@ -22,10 +22,240 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <type_traits>
 #include "amxdebuginfo.h"
+#include "fileutils.h"
+
+namespace {
+
+bool IsBuggedForward(const AMX_DBG_SYMBOL *symbol) {
+  // There seems to be a bug in Pawn compiler 3.2.3664 that adds
+  // forwarded publics to symbol table even if they are not implemented.
+  // Luckily it "works" only for those publics that start with '@'.
+  return (symbol->name[0] == '@');
+}
+
+cell GetCodeStart(const AMX_DBG_SYMBOL *symbol) {
+  return static_cast<cell>(symbol->codestart);
+}
+
+cell GetCodeEnd(const AMX_DBG_SYMBOL *symbol) {
+  return static_cast<cell>(symbol->codeend);
+}
+
+bool CodeStartLess(const AMX_DBG_SYMBOL *lhs, const AMX_DBG_SYMBOL *rhs) {
+  return GetCodeStart(lhs) < GetCodeStart(rhs);
+}
+
+bool CodeStartLessThanAddress(const AMX_DBG_SYMBOL *symbol, cell address) {
+  return GetCodeStart(symbol) < address;
+}
+
+bool AddressLessThanCodeStart(cell address, const AMX_DBG_SYMBOL *symbol) {
+  return address < GetCodeStart(symbol);
+}
+
+bool ArgumentLess(const AMX_DBG_SYMBOL *lhs, const AMX_DBG_SYMBOL *rhs) {
+  if (lhs->codestart != rhs->codestart) {
+    return lhs->codestart < rhs->codestart;
+  }
+  return static_cast<cell>(lhs->address) < static_cast<cell>(rhs->address);
+}
+
+bool AddressLessThanLine(cell address, const AMX_DBG_LINE &line) {
+  return address < static_cast<cell>(line.address);
+}
+
+bool AddressLessThanFile(cell address, const AMX_DBG_FILE *file) {
+  return address < static_cast<cell>(file->address);
+}
+
+uint32_t MakeStateKey(int16_t automaton_id, int16_t state_id) {
+  return (static_cast<uint32_t>(static_cast<uint16_t>(automaton_id)) << 16)
+         | static_cast<uint16_t>(state_id);
+}
+
+typedef std::vector<const AMX_DBG_SYMBOL*> FunctionIndex;
+
+// Finds a function whose code range contains the specified address. If there
+// are several functions starting at the same address the one that comes first
+// in the symbol table wins, just like with a linear search.
+const AMX_DBG_SYMBOL *FindFunction(const FunctionIndex &functions,
+                                   cell address) {
+  FunctionIndex::const_iterator end =
+    std::upper_bound(functions.begin(), functions.end(), address,
+                     AddressLessThanCodeStart);
+  if (end == functions.begin()) {
+    return nullptr;
+  }
+  FunctionIndex::const_iterator it =
+    std::lower_bound(functions.begin(), end, GetCodeStart(*(end - 1)),
+                     CodeStartLessThanAddress);
+  for (; it != end; ++it) {
+    if (GetCodeEnd(*it) > address) {
+      return *it;
+    }
+  }
+  return nullptr;
+}
+
+const AMX_DBG_SYMBOL *FindExactFunction(const FunctionIndex &functions,
+                                        cell address) {
+  FunctionIndex::const_iterator it =
+    std::lower_bound(functions.begin(), functions.end(), address,
+                     CodeStartLessThanAddress);
+  if (it != functions.end() && GetCodeStart(*it) == address) {
+    return *it;
+  }
+  return nullptr;
+}
+
+// Symbols are stored in the same order as they appear in the symbol table,
+// so comparing their addresses tells which one would be found first.
+const AMX_DBG_SYMBOL *First(const AMX_DBG_SYMBOL *lhs,
+                            const AMX_DBG_SYMBOL *rhs) {
+  if (lhs == nullptr) {
+    return rhs;
+  }
+  if (rhs == nullptr) {
+    return lhs;
+  }
+  return std::min(lhs, rhs);
+}
+
+bool IsLittleEndian() {
+  uint16_t value = 1;
+  return *reinterpret_cast<unsigned char*>(&value) == 1;
+}
+
+// Returns a pointer to the byte following the terminating '\0' of the string
+// at ptr, or nullptr if the string is not terminated before end.
+const unsigned char *SkipString(const unsigned char *ptr,
+                                const unsigned char *end) {
+  if (ptr >= end) {
+    return nullptr;
+  }
+  const void *terminator = std::memchr(ptr, '\0', end - ptr);
+  if (terminator == nullptr) {
+    return nullptr;
+  }
+  return static_cast<const unsigned char*>(terminator) + 1;
+}
+
+// Fills a table with pointers to count consecutive name-terminated entries
+// starting at ptr. Names are skipped starting from name_offset to mimic
+// what dbg_LoadInfo() does. Returns a pointer to the end of the last entry
+// or nullptr if the entries don't fit in the buffer.
+template<typename T>
+const unsigned char *MapEntries(const unsigned char *ptr,
+                                const unsigned char *end,
+                                int count,
+                                std::size_t name_offset,
+                                std::vector<T*> &table) {
+  table.reserve(count);
+  for (int i = 0; i < count; i++) {
+    if (ptr == nullptr
+        || static_cast<std::size_t>(end - ptr) < sizeof(T)) {
+      return nullptr;
+    }
+    table.push_back(reinterpret_cast<T*>(const_cast<unsigned char*>(ptr)));
+    ptr = SkipString(ptr + name_offset, end);
+  }
+  return ptr;
+}
+
+bool ReadFile(const std::string &filename, std::vector<unsigned char> &data) {
+  std::FILE *fp = std::fopen(filename.c_str(), "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+  bool ok = false;
+  long size;
+  if (std::fseek(fp, 0, SEEK_END) == 0
+      && (size = std::ftell(fp)) >= 0
+      && std::fseek(fp, 0, SEEK_SET) == 0) {
+    data.resize(static_cast<std::size_t>(size));
+    ok = std::fread(data.data(), 1, data.size(), fp) == data.size();
+  }
+  std::fclose(fp);
+  return ok;
+}
+
+// The index file starts with this header followed by:
+//
+// * offsets of the file, symbol, tag, automaton and state table entries,
+//   function index, bugged functions, arguments and sorted file table
+//   (uint32_t each, relative to the start of the debug info)
+// * slots of the argument, tag, automaton and state lookup tables
+// * sorted line table (AMX_DBG_LINE), if the original one is not sorted
+//
+// The .amx file it belongs to is identified by the hash of its header, its
+// size and its modification time in nanoseconds, like in AMXDebugInfoCache.
+const char kIndexMagic[4] = {'C', 'D', 'I', 'X'};
+const uint32_t kIndexVersion = 2;
+
+struct IndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t amx_header_hash;
+  int64_t amx_size;
+  int64_t amx_mtime;
+  uint32_t debug_offset;
+  uint32_t debug_size;
+  uint32_t num_files;
+  uint32_t num_symbols;
+  uint32_t num_tags;
+  uint32_t num_automata;
+  uint32_t num_states;
+  uint32_t num_functions;
+  uint32_t num_bugged_functions;
+  uint32_t num_arguments;
+  uint32_t num_sorted_files;
+  uint32_t num_argument_slots;
+  uint32_t num_tag_slots;
+  uint32_t num_automaton_slots;
+  uint32_t num_state_slots;
+  uint32_t linetbl_offset;
+  uint32_t num_lines;
+  uint32_t has_sorted_lines;
+};
+
+template<typename Pointer>
+void WriteOffsets(const unsigned char *base,
+                  const Pointer *table,
+                  std::size_t count,
+                  std::vector<uint32_t> &offsets) {
+  for (std::size_t i = 0; i < count; i++) {
+    offsets.push_back(static_cast<uint32_t>(
+      reinterpret_cast<const unsigned char*>(table[i]) - base));
+  }
+}
+
+template<typename Pointer>
+bool ReadOffsets(const unsigned char *base,
+                 std::size_t size,
+                 const uint32_t *&offsets,
+                 uint32_t count,
+                 std::vector<Pointer> &table) {
+  typedef typename std::remove_pointer<Pointer>::type Entry;
+  table.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t offset = offsets[i];
+    if (offset > size || size - offset < sizeof(Entry)) {
+      return false;
+    }
+    table.push_back(
+      reinterpret_cast<Pointer>(const_cast<unsigned char*>(base + offset)));
+  }
+  offsets += count;
+  return true;
+}
+
+} // anonymous namespace
 
 std::vector<AMXDebugInfo::SymbolDim> AMXDebugInfo::Symbol::GetDims() const {
   std::vector<AMXDebugSymbolDim> dims;
@@ -40,12 +270,16 @@ std::vector<AMXDebugInfo::SymbolDim> AMXDebugInfo::Symbol::GetDims() const {
 }
 
 AMXDebugInfo::AMXDebugInfo()
-  : amxdbg_(nullptr)
+  : amxdbg_(nullptr),
+    lines_(nullptr),
+    num_lines_(0)
 {
 }
 
 AMXDebugInfo::AMXDebugInfo(const std::string &filename)
-  : amxdbg_(nullptr)
+  : amxdbg_(nullptr),
+    lines_(nullptr),
+    num_lines_(0)
 {
   Load(filename);
 }
@@ -59,71 +293,551 @@ bool AMXDebugInfo::IsLoaded() const {
 }
 
 void AMXDebugInfo::Load(const std::string &filename) {
-  std::FILE* fp = std::fopen(filename.c_str(), "rb");
-  if (fp != nullptr) {
-    AMX_DBG amxdbg;
-    if (dbg_LoadInfo(&amxdbg, fp) == AMX_ERR_NONE) {
-      amxdbg_ = new AMX_DBG(amxdbg);
+  if (!LoadInPlace(filename)) {
+    Free();
+    std::FILE* fp = std::fopen(filename.c_str(), "rb");
+    if (fp != nullptr) {
+      AMX_DBG amxdbg;
+      if (dbg_LoadInfo(&amxdbg, fp) == AMX_ERR_NONE) {
+        amxdbg_ = new AMX_DBG(amxdbg);
+      }
+      fclose(fp);
     }
-    fclose(fp);
+  }
+  if (amxdbg_ != nullptr) {
+    BuildFunctionIndex();
+    BuildArgumentIndex();
+    BuildLineIndex();
+    BuildTagIndex();
+    BuildStateIndex();
   }
 }
 
-void AMXDebugInfo::Free() {
-  if (amxdbg_ != nullptr) {
-    dbg_FreeInfo(amxdbg_);
-    delete amxdbg_;
+// Does the same thing as dbg_LoadInfo() except that the debug info block is
+// read with a single fread() and the tables are set up to point into it
+// instead of allocating and reading each entry separately.
+bool AMXDebugInfo::LoadInPlace(const std::string &filename) {
+  AMX_HEADER amxhdr;
+  const AMX_DBG_HDR *dbghdr = ReadDebugInfo(filename, amxhdr);
+  if (dbghdr == nullptr) {
+    return false;
   }
+
+  const unsigned char *begin = reinterpret_cast<const unsigned char*>(dbghdr);
+  const unsigned char *end = begin + dbghdr->size;
+  const unsigned char *ptr = begin + sizeof(AMX_DBG_HDR);
+
+  ptr = MapEntries(ptr, end, dbghdr->files, sizeof(AMX_DBG_FILE), filetbl_);
+  if (ptr == nullptr) {
+    return false;
+  }
+
+  const AMX_DBG_LINE *linetbl = reinterpret_cast<const AMX_DBG_LINE*>(ptr);
+  std::size_t lines_size = dbghdr->lines * sizeof(AMX_DBG_LINE);
+  if (static_cast<std::size_t>(end - ptr) < lines_size) {
+    return false;
+  }
+  ptr += lines_size;
+
+  // Skip the rest of the line table if the number of lines overflowed
+  // (see dbg_LoadInfo() for details).
+  std::size_t other_tables_size =
+      sizeof(AMX_DBG_SYMBOL) * dbghdr->symbols
+    + sizeof(AMX_DBG_TAG) * dbghdr->tags
+    + sizeof(AMX_DBG_MACHINE) * dbghdr->automatons
+    + sizeof(AMX_DBG_STATE) * dbghdr->states;
+  if (other_tables_size < dbghdr->size) {
+    const unsigned char *linetbl_max_ptr = end - other_tables_size;
+    ucell codesize = amxhdr.dat - amxhdr.cod;
+    while (ptr < linetbl_max_ptr
+           && static_cast<std::size_t>(linetbl_max_ptr - ptr)
+              > static_cast<std::size_t>(UINT16_MAX) + 1) {
+      const AMX_DBG_LINE *line = reinterpret_cast<const AMX_DBG_LINE*>(ptr);
+      if (line->address <= (line - 1)->address
+          || line->address >= codesize) {
+        break;
+      }
+      ptr += (static_cast<std::size_t>(UINT16_MAX) + 1) * sizeof(AMX_DBG_LINE);
+    }
+  }
+
+  symboltbl_.reserve(dbghdr->symbols);
+  for (int i = 0; i < dbghdr->symbols; i++) {
+    if (ptr == nullptr
+        || static_cast<std::size_t>(end - ptr) < sizeof(AMX_DBG_SYMBOL)) {
+      return false;
+    }
+    AMX_DBG_SYMBOL *symbol =
+      reinterpret_cast<AMX_DBG_SYMBOL*>(const_cast<unsigned char*>(ptr));
+    symboltbl_.push_back(symbol);
+    ptr = SkipString(ptr + sizeof(AMX_DBG_SYMBOL), end);
+    if (ptr == nullptr) {
+      return false;
+    }
+    std::size_t dims_size = symbol->dim * sizeof(AMX_DBG_SYMDIM);
+    if (static_cast<std::size_t>(end - ptr) < dims_size) {
+      return false;
+    }
+    ptr += dims_size;
+  }
+
+  ptr = MapEntries(ptr, end, dbghdr->tags,
+                   sizeof(AMX_DBG_TAG) - 1, tagtbl_);
+  ptr = MapEntries(ptr, end, dbghdr->automatons,
+                   sizeof(AMX_DBG_MACHINE) - 1, automatontbl_);
+  ptr = MapEntries(ptr, end, dbghdr->states,
+                   sizeof(AMX_DBG_STATE) - 1, statetbl_);
+  if (ptr == nullptr) {
+    return false;
+  }
+
+  SetUpTables(dbghdr, linetbl);
+  return true;
 }
 
-AMXDebugLine AMXDebugInfo::GetLine(cell address) const {
-  Line line;
-  LineTable lines = GetLines();
-  for (LineTable::const_reverse_iterator it = lines.crbegin();
-       it != lines.crend(); ++it) {
-    if  (it->GetAddress() <= address) {
-      line = *it;
-      break;
+// Checks that the file contains debug info and reads the debug info block
+// into data_. The file is not kept open, so it can be overwritten (e.g. by
+// recompiling the script) while the debug info is in use. Returns a pointer
+// to the debug info header or nullptr on error.
+const AMX_DBG_HDR *AMXDebugInfo::ReadDebugInfo(const std::string &filename,
+                                               AMX_HEADER &amxhdr) {
+  // Byte order can't be fixed up in place because the tables are used as is.
+  if (!IsLittleEndian()) {
+    return nullptr;
+  }
+  std::FILE *fp = std::fopen(filename.c_str(), "rb");
+  if (fp == nullptr) {
+    return nullptr;
+  }
+
+  const AMX_DBG_HDR *result = nullptr;
+  AMX_DBG_HDR dbghdr;
+  if (std::fread(&amxhdr, sizeof(amxhdr), 1, fp) == 1
+      && amxhdr.magic == AMX_MAGIC
+      && (amxhdr.flags & AMX_FLAG_DEBUG) != 0
+      && amxhdr.size >= static_cast<int32_t>(sizeof(amxhdr))
+      && std::fseek(fp, amxhdr.size, SEEK_SET) == 0
+      && std::fread(&dbghdr, sizeof(dbghdr), 1, fp) == 1
+      && dbghdr.magic == AMX_DBG_MAGIC
+      && dbghdr.size >= static_cast<int32_t>(sizeof(dbghdr))) {
+    data_.resize(dbghdr.size);
+    std::memcpy(data_.data(), &dbghdr, sizeof(dbghdr));
+    std::size_t rest_size = data_.size() - sizeof(dbghdr);
+    if (std::fread(data_.data() + sizeof(dbghdr), 1, rest_size, fp)
+        == rest_size) {
+      result = reinterpret_cast<const AMX_DBG_HDR*>(data_.data());
+    } else {
+      data_.clear();
     }
   }
-  return line;
+  std::fclose(fp);
+  return result;
 }
 
-AMXDebugFile AMXDebugInfo::GetFile(cell address) const {
-  File file;
-  FileTable files = GetFiles();
-  for (FileTable::const_reverse_iterator it = files.crbegin();
-       it != files.crend(); ++it) {
-    if  (it->GetAddress() <= address) {
-      file = *it;
-      break;
+void AMXDebugInfo::SetUpTables(const AMX_DBG_HDR *dbghdr,
+                               const AMX_DBG_LINE *linetbl) {
+  amxdbg_ = new AMX_DBG;
+  amxdbg_->hdr = const_cast<AMX_DBG_HDR*>(dbghdr);
+  amxdbg_->filetbl = filetbl_.empty() ? nullptr : filetbl_.data();
+  amxdbg_->linetbl = const_cast<AMX_DBG_LINE*>(linetbl);
+  amxdbg_->symboltbl = symboltbl_.empty() ? nullptr : symboltbl_.data();
+  amxdbg_->tagtbl = tagtbl_.empty() ? nullptr : tagtbl_.data();
+  amxdbg_->automatontbl =
+    automatontbl_.empty() ? nullptr : automatontbl_.data();
+  amxdbg_->statetbl = statetbl_.empty() ? nullptr : statetbl_.data();
+}
+
+bool AMXDebugInfo::LoadFromIndex(const std::string &filename,
+                                 const std::string &index_filename) {
+  if (!ReadIndex(filename, index_filename)) {
+    Free();
+    return false;
+  }
+  return true;
+}
+
+bool AMXDebugInfo::ReadIndex(const std::string &filename,
+                             const std::string &index_filename) {
+  std::vector<unsigned char> index_data;
+  if (!ReadFile(index_filename, index_data)
+      || index_data.size() < sizeof(IndexHeader)) {
+    return false;
+  }
+
+  IndexHeader header;
+  std::memcpy(&header, index_data.data(), sizeof(header));
+  if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0
+      || header.version != kIndexVersion
+      || header.amx_size != fileutils::GetFileSize(filename)
+      || header.amx_mtime != fileutils::GetModificationTimeNs(filename)) {
+    return false;
+  }
+
+  std::size_t num_offsets =
+      header.num_files
+    + header.num_symbols
+    + header.num_tags
+    + header.num_automata
+    + header.num_states
+    + header.num_functions
+    + header.num_bugged_functions
+    + header.num_arguments
+    + header.num_sorted_files;
+  std::size_t num_slots =
+      header.num_argument_slots
+    + header.num_tag_slots
+    + header.num_automaton_slots
+    + header.num_state_slots;
+  std::size_t num_sorted_lines = header.has_sorted_lines ? header.num_lines : 0;
+  std::size_t expected_size =
+      sizeof(IndexHeader)
+    + num_offsets * sizeof(uint32_t)
+    + num_slots * sizeof(LookupTable::Slot)
+    + num_sorted_lines * sizeof(AMX_DBG_LINE);
+  if (index_data.size() != expected_size) {
+    return false;
+  }
+
+  // Everything else comes from the index, so the debug info block is all
+  // that needs to be read from the .amx file.
+  AMX_HEADER amxhdr;
+  const AMX_DBG_HDR *dbghdr = ReadDebugInfo(filename, amxhdr);
+  if (dbghdr == nullptr
+      || header.amx_header_hash != GetHeaderHash(&amxhdr)
+      || header.debug_offset != static_cast<uint32_t>(amxhdr.size)
+      || header.debug_size != static_cast<uint32_t>(dbghdr->size)
+      || header.num_files != static_cast<uint16_t>(dbghdr->files)
+      || header.num_symbols != static_cast<uint16_t>(dbghdr->symbols)
+      || header.num_tags != static_cast<uint16_t>(dbghdr->tags)
+      || header.num_automata != static_cast<uint16_t>(dbghdr->automatons)
+      || header.num_states != static_cast<uint16_t>(dbghdr->states)) {
+    return false;
+  }
+
+  const unsigned char *base = reinterpret_cast<const unsigned char*>(dbghdr);
+  std::size_t size = dbghdr->size;
+  const uint32_t *offsets = reinterpret_cast<const uint32_t*>(
+    index_data.data() + sizeof(IndexHeader));
+  if (!ReadOffsets(base, size, offsets, header.num_files, filetbl_)
+      || !ReadOffsets(base, size, offsets, header.num_symbols, symboltbl_)
+      || !ReadOffsets(base, size, offsets, header.num_tags, tagtbl_)
+      || !ReadOffsets(base, size, offsets, header.num_automata, automatontbl_)
+      || !ReadOffsets(base, size, offsets, header.num_states, statetbl_)
+      || !ReadOffsets(base, size, offsets, header.num_functions, functions_)
+      || !ReadOffsets(base, size, offsets, header.num_bugged_functions,
+                      bugged_functions_)
+      || !ReadOffsets(base, size, offsets, header.num_arguments, arguments_)
+      || !ReadOffsets(base, size, offsets, header.num_sorted_files, files_)) {
+    return false;
+  }
+
+  const LookupTable::Slot *slots =
+    reinterpret_cast<const LookupTable::Slot*>(offsets);
+  if (!argument_groups_.Load(slots, header.num_argument_slots,
+                             header.num_arguments)
+      || !tags_.Load(slots += header.num_argument_slots,
+                     header.num_tag_slots,
+                     header.num_tags)
+      || !automata_.Load(slots += header.num_tag_slots,
+                         header.num_automaton_slots,
+                         header.num_automata)
+      || !states_.Load(slots += header.num_automaton_slots,
+                       header.num_state_slots,
+                       header.num_states)) {
+    return false;
+  }
+  slots += header.num_state_slots;
+
+  if (header.linetbl_offset > size) {
+    return false;
+  }
+  const AMX_DBG_LINE *linetbl =
+    reinterpret_cast<const AMX_DBG_LINE*>(base + header.linetbl_offset);
+  if (header.has_sorted_lines) {
+    const AMX_DBG_LINE *sorted_lines =
+      reinterpret_cast<const AMX_DBG_LINE*>(slots);
+    sorted_lines_.assign(sorted_lines, sorted_lines + header.num_lines);
+    lines_ = sorted_lines_.data();
+  } else {
+    if ((size - header.linetbl_offset) / sizeof(AMX_DBG_LINE)
+        < header.num_lines) {
+      return false;
     }
+    lines_ = linetbl;
   }
-  return file;
+  num_lines_ = header.num_lines;
+
+  SetUpTables(dbghdr, linetbl);
+  return true;
 }
 
-static bool IsBuggedForward(const AMX_DBG_SYMBOL *symbol) {
-  // There seems to be a bug in Pawn compiler 3.2.3664 that adds
-  // forwarded publics to symbol table even if they are not implemented.
-  // Luckily it "works" only for those publics that start with '@'.
-  return (symbol->name[0] == '@');
+bool AMXDebugInfo::SaveIndex(const std::string &filename,
+                             const std::string &index_filename) const {
+  // Debug info loaded by dbg_LoadInfo() is not in one piece, so there is
+  // nothing the offsets could be relative to.
+  if (amxdbg_ == nullptr || data_.empty()) {
+    return false;
+  }
+
+  AMX_HEADER amxhdr;
+  std::FILE *amx_file = std::fopen(filename.c_str(), "rb");
+  if (amx_file == nullptr) {
+    return false;
+  }
+  std::size_t amxhdr_size = std::fread(&amxhdr, 1, sizeof(amxhdr), amx_file);
+  std::fclose(amx_file);
+  if (amxhdr_size != sizeof(amxhdr)) {
+    return false;
+  }
+
+  const unsigned char *base =
+    reinterpret_cast<const unsigned char*>(amxdbg_->hdr);
+  bool has_sorted_lines = !sorted_lines_.empty() && lines_ == &sorted_lines_[0];
+
+  IndexHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+  header.version = kIndexVersion;
+  header.amx_header_hash = GetHeaderHash(&amxhdr);
+  header.amx_size = fileutils::GetFileSize(filename);
+  header.amx_mtime = fileutils::GetModificationTimeNs(filename);
+  header.debug_offset = amxhdr.size;
+  header.debug_size = amxdbg_->hdr->size;
+  header.num_files = static_cast<uint16_t>(amxdbg_->hdr->files);
+  header.num_symbols = static_cast<uint16_t>(amxdbg_->hdr->symbols);
+  header.num_tags = static_cast<uint16_t>(amxdbg_->hdr->tags);
+  header.num_automata = static_cast<uint16_t>(amxdbg_->hdr->automatons);
+  header.num_states = static_cast<uint16_t>(amxdbg_->hdr->states);
+  header.num_functions = static_cast<uint32_t>(functions_.size());
+  header.num_bugged_functions =
+    static_cast<uint32_t>(bugged_functions_.size());
+  header.num_arguments = static_cast<uint32_t>(arguments_.size());
+  header.num_sorted_files = static_cast<uint32_t>(files_.size());
+  header.num_argument_slots =
+    static_cast<uint32_t>(argument_groups_.slots().size());
+  header.num_tag_slots = static_cast<uint32_t>(tags_.slots().size());
+  header.num_automaton_slots = static_cast<uint32_t>(automata_.slots().size());
+  header.num_state_slots = static_cast<uint32_t>(states_.slots().size());
+  header.linetbl_offset = static_cast<uint32_t>(
+    reinterpret_cast<const unsigned char*>(amxdbg_->linetbl) - base);
+  header.num_lines = static_cast<uint32_t>(num_lines_);
+  header.has_sorted_lines = has_sorted_lines;
+
+  std::vector<uint32_t> offsets;
+  WriteOffsets(base, amxdbg_->filetbl, header.num_files, offsets);
+  WriteOffsets(base, amxdbg_->symboltbl, header.num_symbols, offsets);
+  WriteOffsets(base, amxdbg_->tagtbl, header.num_tags, offsets);
+  WriteOffsets(base, amxdbg_->automatontbl, header.num_automata, offsets);
+  WriteOffsets(base, amxdbg_->statetbl, header.num_states, offsets);
+  WriteOffsets(base, functions_.data(), functions_.size(), offsets);
+  WriteOffsets(base, bugged_functions_.data(), bugged_functions_.size(),
+               offsets);
+  WriteOffsets(base, arguments_.data(), arguments_.size(), offsets);
+  WriteOffsets(base, files_.data(), files_.size(), offsets);
+
+  std::vector<LookupTable::Slot> slots;
+  slots.insert(slots.end(), argument_groups_.slots().begin(),
+               argument_groups_.slots().end());
+  slots.insert(slots.end(), tags_.slots().begin(), tags_.slots().end());
+  slots.insert(slots.end(), automata_.slots().begin(),
+               automata_.slots().end());
+  slots.insert(slots.end(), states_.slots().begin(), states_.slots().end());
+
+  std::FILE *index_file = std::fopen(index_filename.c_str(), "wb");
+  if (index_file == nullptr) {
+    return false;
+  }
+  bool ok = std::fwrite(&header, sizeof(header), 1, index_file) == 1;
+  if (ok && !offsets.empty()) {
+    ok = std::fwrite(&offsets[0], sizeof(uint32_t), offsets.size(),
+                     index_file) == offsets.size();
+  }
+  if (ok && !slots.empty()) {
+    ok = std::fwrite(&slots[0], sizeof(LookupTable::Slot), slots.size(),
+                     index_file) == slots.size();
+  }
+  if (ok && has_sorted_lines) {
+    ok = std::fwrite(&sorted_lines_[0], sizeof(AMX_DBG_LINE),
+                     sorted_lines_.size(), index_file) == sorted_lines_.size();
+  }
+  std::fclose(index_file);
+  if (!ok) {
+    std::remove(index_filename.c_str());
+  }
+  return ok;
 }
 
-AMXDebugSymbol AMXDebugInfo::GetFunction(
-  cell address, bool ignoreBrokenSymbols) const
-{
-  Symbol function;
+void AMXDebugInfo::BuildFunctionIndex() {
   SymbolTable symbols = GetSymbols();
   for (SymbolTable::const_iterator it = symbols.begin();
        it != symbols.end(); ++it) {
-    if (!it->IsFunction())
-      continue;
-    if (it->GetCodeStart() > address || it->GetCodeEnd() <= address)
+    if (!it->IsFunction()) {
       continue;
-    if (ignoreBrokenSymbols && IsBuggedForward(it->GetPOD())) 
-      continue;
-    function = *it;
-    break;
+    }
+    if (IsBuggedForward(it->GetPOD())) {
+      bugged_functions_.push_back(it->GetPOD());
+    } else {
+      functions_.push_back(it->GetPOD());
+    }
+  }
+  std::stable_sort(functions_.begin(), functions_.end(), CodeStartLess);
+}
+
+void AMXDebugInfo::BuildArgumentIndex() {
+  for (int i = 0; i < amxdbg_->hdr->symbols; i++) {
+    AMX_DBG_SYMBOL *symbol = amxdbg_->symboltbl[i];
+    if (symbol->vclass == Symbol::Local) {
+      arguments_.push_back(symbol);
+    }
+  }
+  std::stable_sort(arguments_.begin(), arguments_.end(), ArgumentLess);
+
+  std::size_t num_groups = 0;
+  for (std::size_t i = 0; i < arguments_.size(); i++) {
+    if (i == 0 || arguments_[i]->codestart != arguments_[i - 1]->codestart) {
+      num_groups++;
+    }
+  }
+  argument_groups_.Reserve(num_groups);
+  for (std::size_t i = 0; i < arguments_.size(); i++) {
+    if (i == 0 || arguments_[i]->codestart != arguments_[i - 1]->codestart) {
+      argument_groups_.Insert(static_cast<uint32_t>(arguments_[i]->codestart),
+                              static_cast<uint32_t>(i));
+    }
+  }
+}
+
+void AMXDebugInfo::BuildLineIndex() {
+  // hdr->lines is only 16 bits wide and overflows in large scripts, so
+  // the real size of the line table is determined by where the next table
+  // begins. Tables that are empty are skipped.
+  const unsigned char *lines_end =
+    reinterpret_cast<const unsigned char*>(amxdbg_->hdr) + amxdbg_->hdr->size;
+  if (amxdbg_->hdr->symbols > 0) {
+    lines_end = reinterpret_cast<const unsigned char*>(amxdbg_->symboltbl[0]);
+  } else if (amxdbg_->hdr->tags > 0) {
+    lines_end = reinterpret_cast<const unsigned char*>(amxdbg_->tagtbl[0]);
+  } else if (amxdbg_->hdr->automatons > 0) {
+    lines_end =
+      reinterpret_cast<const unsigned char*>(amxdbg_->automatontbl[0]);
+  } else if (amxdbg_->hdr->states > 0) {
+    lines_end = reinterpret_cast<const unsigned char*>(amxdbg_->statetbl[0]);
+  }
+  std::size_t num_lines = (
+    lines_end - reinterpret_cast<const unsigned char*>(amxdbg_->linetbl)
+  ) / sizeof(AMX_DBG_LINE);
+
+  lines_ = amxdbg_->linetbl;
+  num_lines_ = num_lines;
+
+  // If the table is malformed, make a copy without the entries that go
+  // backwards so that binary search still works.
+  for (std::size_t i = 1; i < num_lines; i++) {
+    if (amxdbg_->linetbl[i].address < amxdbg_->linetbl[i - 1].address) {
+      for (std::size_t j = 0; j < num_lines; j++) {
+        const AMX_DBG_LINE &line = amxdbg_->linetbl[j];
+        if (sorted_lines_.empty()
+            || line.address >= sorted_lines_.back().address) {
+          sorted_lines_.push_back(line);
+        }
+      }
+      lines_ = sorted_lines_.data();
+      num_lines_ = sorted_lines_.size();
+      break;
+    }
+  }
+
+  files_.reserve(amxdbg_->hdr->files);
+  for (int i = 0; i < amxdbg_->hdr->files; i++) {
+    const AMX_DBG_FILE *file = amxdbg_->filetbl[i];
+    if (files_.empty() || file->address >= files_.back()->address) {
+      files_.push_back(file);
+    }
+  }
+}
+
+void AMXDebugInfo::BuildTagIndex() {
+  // Like with linear search, if a tag ID occurs more than once the first
+  // entry wins (Insert() doesn't replace existing entries).
+  tags_.Reserve(amxdbg_->hdr->tags);
+  for (int i = 0; i < amxdbg_->hdr->tags; i++) {
+    const AMX_DBG_TAG *tag = amxdbg_->tagtbl[i];
+    tags_.Insert(static_cast<uint32_t>(tag->tag), i);
+  }
+}
+
+void AMXDebugInfo::BuildStateIndex() {
+  automata_.Reserve(amxdbg_->hdr->automatons);
+  for (int i = 0; i < amxdbg_->hdr->automatons; i++) {
+    const AMX_DBG_MACHINE *automaton = amxdbg_->automatontbl[i];
+    automata_.Insert(static_cast<uint32_t>(automaton->address), i);
+  }
+  states_.Reserve(amxdbg_->hdr->states);
+  for (int i = 0; i < amxdbg_->hdr->states; i++) {
+    const AMX_DBG_STATE *state = amxdbg_->statetbl[i];
+    states_.Insert(MakeStateKey(state->automaton, state->state), i);
+  }
+}
+
+void AMXDebugInfo::Free() {
+  if (amxdbg_ != nullptr) {
+    if (data_.empty()) {
+      dbg_FreeInfo(amxdbg_);
+    }
+    delete amxdbg_;
+    amxdbg_ = nullptr;
+  }
+  data_.clear();
+  filetbl_.clear();
+  symboltbl_.clear();
+  tagtbl_.clear();
+  automatontbl_.clear();
+  statetbl_.clear();
+  functions_.clear();
+  bugged_functions_.clear();
+  arguments_.clear();
+  argument_groups_.Clear();
+  lines_ = nullptr;
+  num_lines_ = 0;
+  sorted_lines_.clear();
+  files_.clear();
+  tags_.Clear();
+  automata_.Clear();
+  states_.Clear();
+}
+
+AMXDebugLine AMXDebugInfo::GetLine(cell address) const {
+  const AMX_DBG_LINE *it =
+    std::upper_bound(lines_, lines_ + num_lines_, address,
+                     AddressLessThanLine);
+  if (it == lines_) {
+    return Line();
+  }
+  return *(it - 1);
+}
+
+AMXDebugFile AMXDebugInfo::GetFile(cell address) const {
+  std::vector<const AMX_DBG_FILE*>::const_iterator it =
+    std::upper_bound(files_.begin(), files_.end(), address,
+                     AddressLessThanFile);
+  if (it == files_.begin()) {
+    return File();
+  }
+  return *(it - 1);
+}
+
+AMXDebugSymbol AMXDebugInfo::GetFunction(
+  cell address, bool ignoreBrokenSymbols) const
+{
+  const AMX_DBG_SYMBOL *function = FindFunction(functions_, address);
+  if (!ignoreBrokenSymbols) {
+    for (FunctionIndex::const_iterator it = bugged_functions_.begin();
+         it != bugged_functions_.end(); ++it) {
+      if (GetCodeStart(*it) <= address && GetCodeEnd(*it) > address) {
+        function = First(function, *it);
+        break;
+      }
+    }
   }
   return function;
 }
@@ -131,61 +845,59 @@ AMXDebugSymbol AMXDebugInfo::GetFunction(
 AMXDebugSymbol AMXDebugInfo::GetExactFunction(
   cell address, bool ignoreBrokenSymbols) const
 {
-  Symbol function;
-  SymbolTable symbols = GetSymbols();
-  for (SymbolTable::const_iterator it = symbols.begin();
-       it != symbols.end(); ++it) {
-    if (!it->IsFunction())
-      continue;
-    if (ignoreBrokenSymbols && IsBuggedForward(it->GetPOD())) 
-      continue;
-    if (it->GetCodeStart() == address) {
-      function = *it;
-      break;
+  const AMX_DBG_SYMBOL *function = FindExactFunction(functions_, address);
+  if (!ignoreBrokenSymbols) {
+    for (FunctionIndex::const_iterator it = bugged_functions_.begin();
+         it != bugged_functions_.end(); ++it) {
+      if (GetCodeStart(*it) == address) {
+        function = First(function, *it);
+        break;
+      }
     }
   }
   return function;
 }
 
+AMXDebugInfo::SymbolTable AMXDebugInfo::GetArguments(
+  cell function_address) const
+{
+  uint32_t begin;
+  if (!argument_groups_.Find(static_cast<uint32_t>(function_address), begin)) {
+    return SymbolTable(nullptr, 0);
+  }
+  std::size_t end = begin + 1;
+  while (end < arguments_.size()
+         && arguments_[end]->codestart == arguments_[begin]->codestart) {
+    end++;
+  }
+  return SymbolTable(const_cast<AMX_DBG_SYMBOL**>(&arguments_[begin]),
+                     end - begin);
+}
+
 AMXDebugTag AMXDebugInfo::GetTag(int32_t tag_id) const {
-  Tag tag;
-  TagTable tags = GetTags();
-  for (TagTable::const_iterator it = tags.begin();
-       it != tags.end(); ++it) {
-    if (it->GetID() == tag_id) {
-      tag = *it;
-      break;
-    }
+  uint32_t index;
+  if (tags_.Find(static_cast<uint32_t>(tag_id), index)) {
+    return amxdbg_->tagtbl[index];
   }
-  return tag;
+  return Tag();
 }
 
 AMXDebugAutomaton AMXDebugInfo::GetAutomaton(cell address) const {
-  Automaton automaton;
-  AutomatonTable automata = GetAutomata();
-  for (AutomatonTable::const_iterator it = automata.begin();
-       it != automata.end(); ++it) {
-    if (it->GetAddress() == address) {
-      automaton = *it;
-      break;
-    }
+  uint32_t index;
+  if (automata_.Find(static_cast<uint32_t>(address), index)) {
+    return amxdbg_->automatontbl[index];
   }
-  return automaton;
+  return Automaton();
 }
 
 AMXDebugState AMXDebugInfo::GetState(
   int16_t automaton_id, int16_t state_id) const
 {
-  State state;
-  StateTable states = GetStates();
-  for (StateTable::const_iterator it = states.begin();
-       it != states.end(); ++it) {
-    if (it->GetAutomaton() == automaton_id && it->GetID() == state_id) {
-      state = *it;
-      break;
-    }
+  uint32_t index;
+  if (states_.Find(MakeStateKey(automaton_id, state_id), index)) {
+    return amxdbg_->statetbl[index];
   }
-  return state;
+  return State();
 }
 
 int32_t AMXDebugInfo::GetLineNumber(cell address) const {
@@ -236,6 +948,103 @@ cell AMXDebugInfo::GetLineAddress(long line, const std::string &file) const {
   return static_cast<cell>(address);
 }
 
+void AMXDebugInfo::LookupTable::Reserve(std::size_t count) {
+  // Keep the table at most half full so that probe sequences stay short and
+  // there is always an empty slot to stop at.
+  bits_ = 1;
+  while ((static_cast<std::size_t>(1) << bits_) < count * 2) {
+    bits_++;
+  }
+  Slot empty = {0, kEmpty};
+  slots_.assign(static_cast<std::size_t>(1) << bits_, empty);
+}
+
+void AMXDebugInfo::LookupTable::Insert(uint32_t key, uint32_t value) {
+  assert(!slots_.empty() && value != kEmpty);
+  std::size_t mask = slots_.size() - 1;
+  for (std::size_t i = GetSlotIndex(key); ; i = (i + 1) & mask) {
+    Slot &slot = slots_[i];
+    if (slot.value == kEmpty) {
+      slot.key = key;
+      slot.value = value;
+      return;
+    }
+    if (slot.key == key) {
+      return;
+    }
+  }
+}
+
+bool AMXDebugInfo::LookupTable::Find(uint32_t key, uint32_t &value) const {
+  if (slots_.empty()) {
+    return false;
+  }
+  std::size_t mask = slots_.size() - 1;
+  for (std::size_t i = GetSlotIndex(key); ; i = (i + 1) & mask) {
+    const Slot &slot = slots_[i];
+    if (slot.value == kEmpty) {
+      return false;
+    }
+    if (slot.key == key) {
+      value = slot.value;
+      return true;
+    }
+  }
+}
+
+bool AMXDebugInfo::LookupTable::Load(const Slot *slots,
+                                     std::size_t count,
+                                     uint32_t max_value) {
+  int bits = 1;
+  while ((static_cast<std::size_t>(1) << bits) < count) {
+    bits++;
+  }
+  if ((static_cast<std::size_t>(1) << bits) != count) {
+    return false;
+  }
+  bool has_empty_slot = false;
+  for (std::size_t i = 0; i < count; i++) {
+    if (slots[i].value == kEmpty) {
+      has_empty_slot = true;
+    } else if (slots[i].value >= max_value) {
+      return false;
+    }
+  }
+  if (!has_empty_slot) {
+    return false;
+  }
+  slots_.assign(slots, slots + count);
+  bits_ = bits;
+  return true;
+}
+
+void AMXDebugInfo::LookupTable::Clear() {
+  slots_.clear();
+  bits_ = 0;
+}
+
+std::size_t AMXDebugInfo::LookupTable::GetSlotIndex(uint32_t key) const {
+  // Fibonacci hashing: take the top bits of the product so that keys that
+  // only differ in their high bits (like addresses) are spread out too.
+  return static_cast<std::size_t>(
+    (key * 0x9E3779B97F4A7C15ULL) >> (64 - bits_));
+}
+
+// static
+uint64_t AMXDebugInfo::GetHeaderHash(const AMX_HEADER *header) {
+  AMX_HEADER copy = *header;
+  copy.flags = 0;
+
+  // 64-bit FNV-1a
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&copy);
+  uint64_t hash = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < sizeof(copy); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
 // static
 bool AMXDebugInfo::IsPresent(AMX *amx) {
   uint16_t flags;
@@ -282,6 +282,16 @@ class AMXDebugInfo {
   bool IsLoaded() const;
   void Free();
 
+  // Loads debug info using an index file previously written by SaveIndex().
+  // Only the debug info block is read from the .amx file, the lookup tables
+  // come from the index. Returns false if the index is missing or doesn't
+  // match the .amx file (its size and modification time are checked the same
+  // way as by AMXDebugInfoCache).
+  bool LoadFromIndex(const std::string &filename,
+                     const std::string &index_filename);
+  bool SaveIndex(const std::string &filename,
+                 const std::string &index_filename) const;
+
   Line GetLine(cell address) const;
   File GetFile(cell address) const;
   Symbol GetFunction(cell address, bool ignoreBrokenSymbols = true) const;
@@ -320,23 +330,117 @@ class AMXDebugInfo {
   AMXDEBUGINFO_TABLE_GETTER(Automata, Automaton, automatontbl, automatons);
   AMXDEBUGINFO_TABLE_GETTER(States, State, statetbl, states);
 
+  // Returns the arguments of the function starting at the specified address
+  // sorted by their stack offset.
+  SymbolTable GetArguments(cell function_address) const;
+
   LineTable GetLines() const {
-    // Work around possible overflow of amxdbg_->hdr->lines.
-    int num_lines = (
-      reinterpret_cast<unsigned char*>(amxdbg_->symboltbl[0]) -
-      reinterpret_cast<unsigned char*>(amxdbg_->linetbl)
-    ) / sizeof(AMX_DBG_LINE);
-    return LineTable(amxdbg_->linetbl, num_lines);
+    return LineTable(const_cast<AMX_DBG_LINE*>(lines_), num_lines_);
   }
 
   static bool IsPresent(AMX *amx);
 
+  // Computes a hash of an AMX header that can be used to identify a script.
+  // Flags are ignored because they may change at run time.
+  static uint64_t GetHeaderHash(const AMX_HEADER *header);
+
  private:
   AMXDebugInfo(const AMXDebugInfo &);
   AMXDebugInfo &operator=(const AMXDebugInfo &);
 
+  // Maps 32-bit keys to indices into one of the tables. Unlike
+  // std::unordered_map this is a flat array (open addressing with linear
+  // probing), so it can be saved to the index file and loaded back as is.
+  class LookupTable {
+   public:
+    struct Slot {
+      uint32_t key;
+      uint32_t value;
+    };
+
+    LookupTable() : bits_(0) {}
+
+    // Makes room for count entries. Must be called before Insert().
+    void Reserve(std::size_t count);
+
+    // Like std::unordered_map::insert(), keeps the existing value if the
+    // key is already there.
+    void Insert(uint32_t key, uint32_t value);
+    bool Find(uint32_t key, uint32_t &value) const;
+
+    // Takes slots that were returned by slots(). Returns false if they
+    // don't make a valid table or have values of max_value or above.
+    bool Load(const Slot *slots, std::size_t count, uint32_t max_value);
+    const std::vector<Slot> &slots() const { return slots_; }
+
+    void Clear();
+
+   private:
+    static const uint32_t kEmpty = 0xFFFFFFFF;
+
+    std::size_t GetSlotIndex(uint32_t key) const;
+
+   private:
+    std::vector<Slot> slots_;
+    int bits_;
+  };
+
+  bool LoadInPlace(const std::string &filename);
+  bool ReadIndex(const std::string &filename,
+                 const std::string &index_filename);
+  const AMX_DBG_HDR *ReadDebugInfo(const std::string &filename,
+                                   AMX_HEADER &amxhdr);
+  void SetUpTables(const AMX_DBG_HDR *dbghdr,
+                   const AMX_DBG_LINE *linetbl);
+
+  void BuildFunctionIndex();
+  void BuildArgumentIndex();
+  void BuildLineIndex();
+  void BuildTagIndex();
+  void BuildStateIndex();
+
  private:
   AMX_DBG *amxdbg_;
+
+  // Unless the debug info is loaded by dbg_LoadInfo(), the debug info block
+  // is read into data_ and all tables point into it. The pointer tables that
+  // would normally be allocated by dbg_LoadInfo() live here as well.
+  std::vector<unsigned char> data_;
+  std::vector<AMX_DBG_FILE*> filetbl_;
+  std::vector<AMX_DBG_SYMBOL*> symboltbl_;
+  std::vector<AMX_DBG_TAG*> tagtbl_;
+  std::vector<AMX_DBG_MACHINE*> automatontbl_;
+  std::vector<AMX_DBG_STATE*> statetbl_;
+
+  // Function symbols sorted by code start address. Bugged forwards (see
+  // IsBuggedForward()) are kept separately because their code ranges are
+  // not reliable and would otherwise break binary search.
+  std::vector<const AMX_DBG_SYMBOL*> functions_;
+  std::vector<const AMX_DBG_SYMBOL*> bugged_functions_;
+
+  // Function arguments (i.e. local symbols whose scope starts at the
+  // function's address) grouped by function and sorted by address within
+  // each group, plus the index of the first argument of each group in
+  // arguments_ by function address.
+  std::vector<AMX_DBG_SYMBOL*> arguments_;
+  LookupTable argument_groups_;
+
+  // Line table sorted by address, for binary search. It normally points to
+  // the original table and only refers to sorted_lines_ if the original one
+  // is out of order.
+  const AMX_DBG_LINE *lines_;
+  std::size_t num_lines_;
+  std::vector<AMX_DBG_LINE> sorted_lines_;
+
+  // File table entries sorted by address.
+  std::vector<const AMX_DBG_FILE*> files_;
+
+  // Tags are looked up by ID, automata by state variable address and states
+  // by automaton and state ID combined into a single key. The values are
+  // indices into tagtbl, automatontbl and statetbl respectively.
+  LookupTable tags_;
+  LookupTable automata_;
+  LookupTable states_;
 };
 
 typedef AMXDebugInfo::File AMXDebugFile;
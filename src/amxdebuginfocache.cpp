@@ -0,0 +1,112 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <amx/amx.h>
+#include "amxdebuginfo.h"
+#include "amxdebuginfocache.h"
+#include "fileutils.h"
+#include "options.h"
+
+bool AMXDebugInfoCache::Key::operator<(const Key &rhs) const {
+  if (header_hash != rhs.header_hash) {
+    return header_hash < rhs.header_hash;
+  }
+  if (file_size != rhs.file_size) {
+    return file_size < rhs.file_size;
+  }
+  return file_mtime < rhs.file_mtime;
+}
+
+AMXDebugInfoCache::AMXDebugInfoCache() {
+}
+
+std::shared_ptr<const AMXDebugInfo> AMXDebugInfoCache::Get(
+  AMX *amx,
+  const std::string &path)
+{
+  Key key;
+  key.header_hash =
+    AMXDebugInfo::GetHeaderHash(reinterpret_cast<AMX_HEADER*>(amx->base));
+  key.file_size = fileutils::GetFileSize(path);
+  key.file_mtime = fileutils::GetModificationTimeNs(path);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  EntryMap::const_iterator it = entries_.find(key);
+  if (it != entries_.end()) {
+    return it->second;
+  }
+
+  std::shared_ptr<AMXDebugInfo> debug_info(new AMXDebugInfo);
+  if (Options::shared().debug_info_index()) {
+    std::string index_path = path + ".cdidx";
+    if (!debug_info->LoadFromIndex(path, index_path)) {
+      debug_info->Load(path);
+      if (debug_info->IsLoaded()) {
+        debug_info->SaveIndex(path, index_path);
+      }
+    }
+  } else {
+    debug_info->Load(path);
+  }
+  if (debug_info->IsLoaded()) {
+    // A new version of a script has likely been loaded, drop the ones
+    // that are no longer used by anyone.
+    RemoveUnused();
+    entries_.insert(std::make_pair(key, debug_info));
+  }
+  return debug_info;
+}
+
+void AMXDebugInfoCache::Release(
+  std::shared_ptr<const AMXDebugInfo> &debug_info)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  debug_info.reset();
+  RemoveUnused();
+}
+
+void AMXDebugInfoCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+}
+
+void AMXDebugInfoCache::RemoveUnused() {
+  for (EntryMap::iterator it = entries_.begin(); it != entries_.end(); ) {
+    if (it->second.use_count() == 1) {
+      it = entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// static
+AMXDebugInfoCache &AMXDebugInfoCache::shared() {
+  static AMXDebugInfoCache instance;
+  return instance;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef AMXDEBUGINFOCACHE_H
+#define AMXDEBUGINFOCACHE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <amx/amx.h>
+#include "amxdebuginfo.h"
+
+// Keeps debug info of loaded scripts so that it can be shared by multiple
+// instances of the same script. An entry lives as long as at least one
+// script uses it.
+class AMXDebugInfoCache {
+ public:
+  std::shared_ptr<const AMXDebugInfo> Get(AMX *amx, const std::string &path);
+
+  // Drops a reference obtained from Get() and removes the entry if it was
+  // the last one.
+  void Release(std::shared_ptr<const AMXDebugInfo> &debug_info);
+
+  void Clear();
+
+  static AMXDebugInfoCache &shared();
+
+ private:
+  AMXDebugInfoCache();
+  AMXDebugInfoCache(const AMXDebugInfoCache &);
+  AMXDebugInfoCache &operator=(const AMXDebugInfoCache &);
+
+  // Identifies a particular build of a script. The modification time is in
+  // nanoseconds, so a script recompiled within the same second still gets a
+  // new key on file systems that keep sub-second times.
+  struct Key {
+    uint64_t header_hash;
+    long long file_size;
+    long long file_mtime;
+
+    bool operator<(const Key &rhs) const;
+  };
+
+  void RemoveUnused();
+
+ private:
+  typedef std::map<Key, std::shared_ptr<const AMXDebugInfo>> EntryMap;
+  EntryMap entries_;
+  std::mutex mutex_;
+};
+
+#endif // !AMXDEBUGINFOCACHE_H
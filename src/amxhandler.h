@@ -40,6 +40,19 @@ class AMXHandler {
   static T *GetHandler(AMX *amx);
   static void DestroyHandler(AMX *amx);
 
+  template<typename Func>
+  static void ForEachHandler(Func func);
+
+ private:
+  // Handlers are stored in one of the AMX's user data slots so that
+  // GetHandler() doesn't have to search the map on every hook call. The map
+  // is still kept for enumeration and as a fallback for the case when all
+  // slots are already taken by someone else.
+  static const long kUserDataTag = AMX_USERTAG('c', 'd', 'h', 'd');
+
+  static bool SetUserData(AMX *amx, T *handler);
+  static void ClearUserData(AMX *amx);
+
  private:
   AMX *amx_;
 
@@ -56,12 +69,18 @@ template<typename T>
 T *AMXHandler<T>::CreateHandler(AMX *amx) {
   T *handler = new T(amx);
   handlers_.insert(std::make_pair(amx, handler));
+  SetUserData(amx, handler);
   return handler;
 }
 
 // static
 template<typename T>
 T *AMXHandler<T>::GetHandler(AMX *amx) {
+  for (int i = 0; i < AMX_USERNUM; i++) {
+    if (amx->usertags[i] == kUserDataTag) {
+      return static_cast<T*>(amx->userdata[i]);
+    }
+  }
   typename HandlerMap::const_iterator iterator = handlers_.find(amx);
   if (iterator != handlers_.end()) {
     return iterator->second;
@@ -76,8 +95,37 @@ void AMXHandler<T>::DestroyHandler(AMX *amx) {
   if (iterator != handlers_.end()) {
     T *handler = iterator->second;
     handlers_.erase(iterator);
+    ClearUserData(amx);
     delete handler;
   }
 }
 
+// static
+template<typename T>
+template<typename Func>
+void AMXHandler<T>::ForEachHandler(Func func) {
+  for (typename HandlerMap::const_iterator iterator = handlers_.begin();
+       iterator != handlers_.end(); iterator++) {
+    func(iterator->second);
+  }
+}
+
+// static
+template<typename T>
+bool AMXHandler<T>::SetUserData(AMX *amx, T *handler) {
+  return amx_SetUserData(amx, kUserDataTag, handler) == AMX_ERR_NONE;
+}
+
+// static
+template<typename T>
+void AMXHandler<T>::ClearUserData(AMX *amx) {
+  // amx_SetUserData() can't release a slot, so reset the tag directly.
+  for (int i = 0; i < AMX_USERNUM; i++) {
+    if (amx->usertags[i] == kUserDataTag) {
+      amx->usertags[i] = 0;
+      amx->userdata[i] = nullptr;
+    }
+  }
+}
+
 #endif // !AMXHANDLER_H
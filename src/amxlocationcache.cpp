@@ -0,0 +1,88 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <cassert>
+#include <mutex>
+#include <string>
+#include "amxlocationcache.h"
+
+AMXLocationCache::AMXLocationCache(std::size_t size)
+  : entries_(size),
+    hits_(0),
+    misses_(0)
+{
+}
+
+bool AMXLocationCache::Get(Kind kind, cell address, std::string &text) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.empty()) {
+    misses_++;
+    return false;
+  }
+  Entry &entry = GetEntry(kind, address);
+  if (entry.used && entry.kind == kind && entry.address == address) {
+    hits_++;
+    text = entry.text;
+    return true;
+  }
+  misses_++;
+  return false;
+}
+
+void AMXLocationCache::Put(Kind kind,
+                           cell address,
+                           const std::string &text) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  assert(!entries_.empty());
+  Entry &entry = GetEntry(kind, address);
+  entry.used = true;
+  entry.kind = kind;
+  entry.address = address;
+  entry.text = text;
+}
+
+void AMXLocationCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::size_t i = 0; i < entries_.size(); i++) {
+    entries_[i] = Entry();
+  }
+  hits_ = 0;
+  misses_ = 0;
+}
+
+unsigned long AMXLocationCache::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+unsigned long AMXLocationCache::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+AMXLocationCache::Entry &AMXLocationCache::GetEntry(Kind kind, cell address) {
+  // Code addresses are always cell-aligned, so the lower bits are useless.
+  ucell hash = (static_cast<ucell>(address) / sizeof(cell)) * 2 + kind;
+  return entries_[hash % entries_.size()];
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef AMXLOCATIONCACHE_H
+#define AMXLOCATIONCACHE_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <amx/amx.h>
+
+// A fixed-size cache of formatted function names and source locations
+// (file:line) for code addresses. When two addresses map to the same slot
+// the newer one simply replaces the older one.
+//
+// The cache may be used by several threads at once, so entries are copied
+// in and out under a lock rather than handed out by reference.
+class AMXLocationCache {
+ public:
+  enum Kind {
+    CallerName,
+    SourceLocation
+  };
+
+  explicit AMXLocationCache(std::size_t size);
+
+  bool Get(Kind kind, cell address, std::string &text);
+  void Put(Kind kind, cell address, const std::string &text);
+  void Clear();
+
+  std::size_t size() const { return entries_.size(); }
+  unsigned long hits() const;
+  unsigned long misses() const;
+
+ private:
+  struct Entry {
+    Entry() : used(false), kind(CallerName), address(0) {}
+    bool used;
+    Kind kind;
+    cell address;
+    std::string text;
+  };
+
+  Entry &GetEntry(Kind kind, cell address);
+
+ private:
+  std::vector<Entry> entries_;
+  unsigned long hits_;
+  unsigned long misses_;
+  mutable std::mutex mutex_;
+};
+
+#endif // !AMXLOCATIONCACHE_H
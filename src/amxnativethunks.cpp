@@ -0,0 +1,115 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "amxnativethunks.h"
+
+namespace {
+
+struct ThunkBinding {
+  cell index;
+  AMX_NATIVE native;
+};
+
+ThunkBinding bindings[AMXNativeThunks::kMaxThunks];
+AMXNativeThunks::Handler handler;
+
+template<int N>
+cell AMX_NATIVE_CALL Thunk(AMX *amx, cell *params) {
+  const ThunkBinding &binding = bindings[N];
+  return handler(amx, binding.index, binding.native, params);
+}
+
+// Instantiates Thunk<Begin> ... Thunk<Begin + Count - 1>. The range is
+// split in halves to keep template recursion depth low.
+template<int Begin, int Count>
+struct ThunkTable {
+  static void Fill(AMX_NATIVE *table) {
+    ThunkTable<Begin, Count / 2>::Fill(table);
+    ThunkTable<Begin + Count / 2, Count - Count / 2>::Fill(table);
+  }
+};
+
+template<int Begin>
+struct ThunkTable<Begin, 1> {
+  static void Fill(AMX_NATIVE *table) {
+    table[Begin] = Thunk<Begin>;
+  }
+};
+
+AMX_NATIVE thunks[AMXNativeThunks::kMaxThunks];
+
+} // anonymous namespace
+
+AMXNativeThunks::AMXNativeThunks() {
+  ThunkTable<0, kMaxThunks>::Fill(thunks);
+  for (int i = kMaxThunks - 1; i >= 0; i--) {
+    free_thunks_.push_back(i);
+  }
+}
+
+void AMXNativeThunks::SetHandler(Handler new_handler) {
+  handler = new_handler;
+}
+
+AMX_NATIVE AMXNativeThunks::Get(AMX *amx, cell index, AMX_NATIVE native) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  ThunkMap::const_iterator iterator =
+    thunk_map_.find(std::make_pair(amx, index));
+  if (iterator != thunk_map_.end()) {
+    return thunks[iterator->second];
+  }
+
+  if (free_thunks_.empty()) {
+    return nullptr;
+  }
+
+  int thunk = free_thunks_.back();
+  free_thunks_.pop_back();
+
+  bindings[thunk].index = index;
+  bindings[thunk].native = native;
+  thunk_map_.insert(std::make_pair(std::make_pair(amx, index), thunk));
+
+  return thunks[thunk];
+}
+
+void AMXNativeThunks::Release(AMX *amx) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  ThunkMap::iterator iterator =
+    thunk_map_.lower_bound(std::make_pair(amx, static_cast<cell>(0)));
+  while (iterator != thunk_map_.end() && iterator->first.first == amx) {
+    int thunk = iterator->second;
+    bindings[thunk].native = nullptr;
+    free_thunks_.push_back(thunk);
+    thunk_map_.erase(iterator++);
+  }
+}
+
+// static
+AMXNativeThunks &AMXNativeThunks::shared() {
+  static AMXNativeThunks instance;
+  return instance;
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef AMXNATIVETHUNKS_H
+#define AMXNATIVETHUNKS_H
+
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <amx/amx.h>
+
+// A fixed pool of native functions that can be patched into SYSREQ.D
+// instructions in place of real natives. Each thunk is bound to a native of
+// a particular script and forwards calls to a common handler together with
+// the native's index, so the plugin can still see every native call without
+// going through amx->callback.
+class AMXNativeThunks {
+ public:
+  typedef cell (*Handler)(AMX *amx,
+                          cell index,
+                          AMX_NATIVE native,
+                          cell *params);
+
+  static const int kMaxThunks = 1024;
+
+  void SetHandler(Handler handler);
+
+  // Returns a thunk for the specified native, or nullptr if all thunks are
+  // in use.
+  AMX_NATIVE Get(AMX *amx, cell index, AMX_NATIVE native);
+
+  // Releases all thunks bound to natives of the specified script.
+  void Release(AMX *amx);
+
+  static AMXNativeThunks &shared();
+
+ private:
+  AMXNativeThunks();
+  AMXNativeThunks(const AMXNativeThunks &);
+  AMXNativeThunks &operator=(const AMXNativeThunks &);
+
+ private:
+  typedef std::map<std::pair<AMX*, cell>, int> ThunkMap;
+  ThunkMap thunk_map_;
+  std::vector<int> free_thunks_;
+  std::mutex mutex_;
+};
+
+#endif // !AMXNATIVETHUNKS_H
@@ -0,0 +1,435 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "amxdebuginfo.h"
+#include "amxprofiler.h"
+
+namespace {
+
+struct ReportEntry {
+  const char *type;
+  std::string name;
+  const AMXProfiler::Counters *counters;
+};
+
+bool CompareSelfTime(const ReportEntry &a, const ReportEntry &b) {
+  return a.counters->self_time > b.counters->self_time;
+}
+
+double ToMilliseconds(Clock::duration time) {
+  return std::chrono::duration<double, std::milli>(time).count();
+}
+
+void AddEntry(std::vector<ReportEntry> &entries,
+              const char *type,
+              const std::string &name,
+              const AMXProfiler::Counters &counters) {
+  if (counters.num_calls != 0) {
+    ReportEntry entry = {
+      type,
+      !name.empty() ? name : "<unknown>",
+      &counters
+    };
+    entries.push_back(entry);
+  }
+}
+
+std::string ToString(const char *s) {
+  return s != nullptr ? s : "";
+}
+
+std::string FormatAddress(cell address) {
+  std::stringstream stream;
+  stream << "0x" << std::hex << std::setw(8) << std::setfill('0') << address;
+  return stream.str();
+}
+
+struct LineEntry {
+  std::string location;
+  unsigned long long num_executions;
+  Clock::duration time;
+};
+
+bool CompareTime(const LineEntry &a, const LineEntry &b) {
+  return a.time > b.time;
+}
+
+struct LatencyEntry {
+  const char *name;
+  const LatencyHistogram *histogram;
+  Clock::duration p99;
+};
+
+bool CompareP99(const LatencyEntry &a, const LatencyEntry &b) {
+  return a.p99 > b.p99;
+}
+
+double ToMicroseconds(Clock::duration time) {
+  return std::chrono::duration<double, std::micro>(time).count();
+}
+
+} // anonymous namespace
+
+AMXProfiler::Counters::Counters()
+ : num_calls(0),
+   total_time(0),
+   self_time(0),
+   depth(0)
+{
+}
+
+AMXProfiler::StatementCounters::StatementCounters()
+ : num_executions(0),
+   time(0)
+{
+}
+
+AMXProfiler::AMXProfiler(AMXRef amx,
+                         unsigned int max_lines,
+                         bool native_histograms)
+ : amx_(amx),
+   start_time_(Clock::now()),
+   publics_(amx.GetNumPublics()),
+   natives_(amx.GetNumNatives()),
+   max_lines_(max_lines),
+   last_statement_(nullptr)
+{
+  if (max_lines_ != 0) {
+    const AMX_HEADER *hdr = amx.GetHeader();
+    statements_.resize((hdr->dat - hdr->cod) / sizeof(cell));
+  }
+  if (native_histograms) {
+    native_histograms_.resize(natives_.size());
+  }
+}
+
+AMXProfiler::Counters *AMXProfiler::GetPublicCounters(cell index) {
+  if (index == AMX_EXEC_MAIN) {
+    return &main_;
+  }
+  if (index >= 0 && static_cast<std::size_t>(index) < publics_.size()) {
+    return &publics_[index];
+  }
+  return nullptr;
+}
+
+AMXProfiler::Counters *AMXProfiler::GetNativeCounters(cell index) {
+  if (index >= 0 && static_cast<std::size_t>(index) < natives_.size()) {
+    return &natives_[index];
+  }
+  return nullptr;
+}
+
+AMXProfiler::Counters *AMXProfiler::GetFunctionCounters(cell address) {
+  return &functions_[address];
+}
+
+const LatencyHistogram *AMXProfiler::GetNativeHistogram(cell index) const {
+  if (index >= 0
+      && static_cast<std::size_t>(index) < native_histograms_.size()) {
+    return &native_histograms_[index];
+  }
+  return nullptr;
+}
+
+void AMXProfiler::CountStatement(cell address, Clock::time_point time) {
+  EndStatement(time);
+  std::size_t index = static_cast<std::size_t>(address) / sizeof(cell);
+  if (index < statements_.size()) {
+    last_statement_ = &statements_[index];
+    last_statement_->num_executions++;
+    last_statement_time_ = time;
+  }
+}
+
+void AMXProfiler::EndStatement(Clock::time_point time) {
+  if (last_statement_ != nullptr) {
+    last_statement_->time += time - last_statement_time_;
+    last_statement_ = nullptr;
+  }
+}
+
+void AMXProfiler::WriteReport(std::ostream &stream,
+                              const std::string &title,
+                              const AMXDebugInfo &debug_info) const {
+  std::vector<ReportEntry> entries;
+  AddEntry(entries, "public", "main", main_);
+  for (std::size_t i = 0; i < publics_.size(); i++) {
+    AddEntry(entries, "public", ToString(amx_.GetPublicName(i)), publics_[i]);
+  }
+  for (std::size_t i = 0; i < natives_.size(); i++) {
+    AddEntry(entries, "native", ToString(amx_.GetNativeName(i)), natives_[i]);
+  }
+  for (std::unordered_map<cell, Counters>::const_iterator it =
+         functions_.begin();
+       it != functions_.end(); it++) {
+    std::string name;
+    if (debug_info.IsLoaded()) {
+      name = debug_info.GetFunctionName(it->first);
+    }
+    if (name.empty()) {
+      name = FormatAddress(it->first);
+    }
+    AddEntry(entries, "function", name, it->second);
+  }
+  std::sort(entries.begin(), entries.end(), CompareSelfTime);
+
+  Clock::duration total_self_time(0);
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    total_self_time += entries[i].counters->self_time;
+  }
+
+  stream << title << " (" << std::fixed << std::setprecision(3)
+         << ToMilliseconds(Clock::now() - start_time_) / 1000.0
+         << " s)\n\n";
+  stream << std::left
+         << std::setw(10) << "Type"
+         << std::setw(32) << "Name"
+         << std::right
+         << std::setw(12) << "Calls"
+         << std::setw(14) << "Self, ms"
+         << std::setw(10) << "Self, %"
+         << std::setw(14) << "Total, ms"
+         << std::setw(14) << "Avg, us"
+         << "\n";
+
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    const ReportEntry &entry = entries[i];
+    const Counters &counters = *entry.counters;
+    double self_time = ToMilliseconds(counters.self_time);
+    double total_time = ToMilliseconds(counters.total_time);
+    double self_percent = 0.0;
+    if (total_self_time.count() > 0) {
+      self_percent = 100.0 * counters.self_time.count()
+                           / total_self_time.count();
+    }
+    stream << std::left
+           << std::setw(10) << entry.type
+           << std::setw(32) << entry.name
+           << std::right
+           << std::setw(12) << counters.num_calls
+           << std::setw(14) << std::setprecision(3) << self_time
+           << std::setw(10) << std::setprecision(2) << self_percent
+           << std::setw(14) << std::setprecision(3) << total_time
+           << std::setw(14) << std::setprecision(3)
+           << total_time * 1000.0 / counters.num_calls
+           << "\n";
+  }
+
+  if (!statements_.empty()) {
+    stream << "\n";
+    WriteLineReport(stream, debug_info);
+  }
+}
+
+void AMXProfiler::WriteLineReport(std::ostream &stream,
+                                  const AMXDebugInfo &debug_info) const {
+  // A line may consist of several statements, e.g. a for loop.
+  std::map<std::pair<std::string, int32_t>, LineEntry> lines;
+  Clock::duration total_time(0);
+
+  for (std::size_t i = 0; i < statements_.size(); i++) {
+    const StatementCounters &statement = statements_[i];
+    if (statement.num_executions == 0) {
+      continue;
+    }
+    cell address = static_cast<cell>(i * sizeof(cell));
+    std::pair<std::string, int32_t> key(std::string(), -1);
+    if (debug_info.IsLoaded()) {
+      key.first = debug_info.GetFileName(address);
+      key.second = debug_info.GetLineNumber(address);
+    }
+    LineEntry &line = lines[key];
+    if (line.location.empty()) {
+      std::stringstream location;
+      if (key.second >= 0) {
+        location << (key.first.empty() ? "<unknown file>" : key.first)
+                 << ":" << key.second + 1;
+      } else {
+        location << FormatAddress(address);
+      }
+      line.location = location.str();
+      line.num_executions = 0;
+      line.time = Clock::duration(0);
+    }
+    // Take the count of the line's most executed statement rather than the
+    // sum, so that e.g. a for loop is not counted several times per
+    // iteration.
+    line.num_executions = std::max<unsigned long long>(line.num_executions,
+                                                      statement.num_executions);
+    line.time += statement.time;
+    total_time += statement.time;
+  }
+
+  std::vector<LineEntry> entries;
+  entries.reserve(lines.size());
+  for (std::map<std::pair<std::string, int32_t>, LineEntry>::const_iterator
+         it = lines.begin();
+       it != lines.end(); it++) {
+    entries.push_back(it->second);
+  }
+  std::sort(entries.begin(), entries.end(), CompareTime);
+  if (entries.size() > max_lines_) {
+    entries.resize(max_lines_);
+  }
+
+  stream << std::left
+         << std::setw(48) << "Line"
+         << std::right
+         << std::setw(14) << "Executions"
+         << std::setw(14) << "Time, ms"
+         << std::setw(10) << "Time, %"
+         << "\n";
+
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    const LineEntry &entry = entries[i];
+    double percent = 0.0;
+    if (total_time.count() > 0) {
+      percent = 100.0 * entry.time.count() / total_time.count();
+    }
+    stream << std::left
+           << std::setw(48) << entry.location
+           << std::right
+           << std::setw(14) << entry.num_executions
+           << std::setw(14) << std::setprecision(3)
+           << ToMilliseconds(entry.time)
+           << std::setw(10) << std::setprecision(2) << percent
+           << "\n";
+  }
+}
+
+
+void AMXProfiler::WriteNativeLatencies(std::ostream &stream) const {
+  std::vector<LatencyEntry> entries;
+  for (std::size_t i = 0; i < native_histograms_.size(); i++) {
+    const LatencyHistogram &histogram = native_histograms_[i];
+    if (histogram.count() != 0) {
+      const char *name = amx_.GetNativeName(static_cast<int>(i));
+      LatencyEntry entry = {
+        name != nullptr ? name : "<unknown>",
+        &histogram,
+        histogram.GetValueAtPercentile(99.0)
+      };
+      entries.push_back(entry);
+    }
+  }
+  std::sort(entries.begin(), entries.end(), CompareP99);
+
+  stream << std::fixed << std::setprecision(1);
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    const LatencyEntry &entry = entries[i];
+    const LatencyHistogram &histogram = *entry.histogram;
+    stream << entry.name
+           << ": p50 "
+           << ToMicroseconds(histogram.GetValueAtPercentile(50.0))
+           << "us, p99 " << ToMicroseconds(entry.p99)
+           << "us, p99.9 "
+           << ToMicroseconds(histogram.GetValueAtPercentile(99.9))
+           << "us, max " << ToMicroseconds(histogram.max())
+           << "us (" << histogram.count() << " calls)\n";
+  }
+}
+
+AMXProfileStack::AMXProfileStack() {
+  frames_.reserve(kInitialCapacity);
+}
+
+void AMXProfileStack::Enter(AMXProfiler::Counters *counters,
+                            Clock::time_point time) {
+  Push(counters, time, 0, 0);
+}
+
+void AMXProfileStack::Leave(Clock::time_point time) {
+  while (IsFunctionOnTop()) {
+    Pop(time);
+  }
+  Pop(time);
+}
+
+bool AMXProfileStack::IsCurrentFunction(cell frm, cell return_address) const {
+  // Public functions are called with a return address of 0.
+  if (return_address == 0) {
+    return !IsFunctionOnTop();
+  }
+  return IsFunctionOnTop()
+    && frames_.back().frm == frm
+    && frames_.back().return_address == return_address;
+}
+
+void AMXProfileStack::SwitchFunction(cell frm,
+                                     cell return_address,
+                                     AMXProfiler::Counters *counters,
+                                     Clock::time_point time) {
+  // The stack grows down, so functions with a lower frame address were
+  // called from this one and have returned. A function with the same frame
+  // but a different return address has returned too, and the one running
+  // now was called right after it (like in f(g())).
+  while (IsFunctionOnTop()
+         && (frames_.back().frm < frm
+             || (frames_.back().frm == frm
+                 && frames_.back().return_address != return_address))) {
+    Pop(time);
+  }
+  if (!IsCurrentFunction(frm, return_address)) {
+    Push(counters, time, frm, return_address);
+  }
+}
+
+void AMXProfileStack::Push(AMXProfiler::Counters *counters,
+                           Clock::time_point time,
+                           cell frm,
+                           cell return_address) {
+  Frame frame = {counters, time, Clock::duration(0), frm, return_address};
+  frames_.push_back(frame);
+  if (counters != nullptr) {
+    counters->depth++;
+  }
+}
+
+void AMXProfileStack::Pop(Clock::time_point time) {
+  assert(!frames_.empty());
+  Frame frame = frames_.back();
+  frames_.pop_back();
+
+  Clock::duration elapsed_time = time - frame.start_time;
+  if (frame.counters != nullptr) {
+    frame.counters->num_calls++;
+    frame.counters->self_time += elapsed_time - frame.child_time;
+    if (--frame.counters->depth == 0) {
+      frame.counters->total_time += elapsed_time;
+    }
+  }
+  if (!frames_.empty()) {
+    frames_.back().child_time += elapsed_time;
+  }
+}
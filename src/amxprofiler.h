@@ -0,0 +1,191 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef AMXPROFILER_H
+#define AMXPROFILER_H
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "amxref.h"
+#include "clock.h"
+#include "latencyhistogram.h"
+
+class AMXDebugInfo;
+
+// Collects the number of calls and the time spent in each public and native
+// function of a script. Counters are kept in flat arrays indexed by public
+// and native index, so updating them doesn't involve any lookups. Other
+// functions are optional and are looked up by their address.
+//
+// It can also count executed statements, in a flat array indexed by the
+// address of each statement's BREAK instruction (divided by cell size).
+class AMXProfiler {
+ public:
+  struct Counters {
+    Counters();
+
+    unsigned long long num_calls;
+    Clock::duration total_time; // including nested calls
+    Clock::duration self_time;  // excluding nested calls
+
+    // Number of calls currently in progress. total_time is only added up
+    // when the outermost one returns, otherwise recursive calls would be
+    // counted more than once.
+    unsigned int depth;
+  };
+
+  // If max_lines is not 0, statements are counted as well and the report
+  // includes that many of the most expensive source lines. If
+  // native_histograms is true, RecordNativeTime() keeps a latency histogram
+  // for each native.
+  explicit AMXProfiler(AMXRef amx,
+                       unsigned int max_lines = 0,
+                       bool native_histograms = false);
+
+  // These return nullptr for indexes that don't refer to a function, like
+  // AMX_EXEC_CONT.
+  Counters *GetPublicCounters(cell index);
+  Counters *GetNativeCounters(cell index);
+  Counters *GetFunctionCounters(cell address);
+
+  void RecordNativeTime(cell index, Clock::duration time) {
+    if (static_cast<ucell>(index) < native_histograms_.size()) {
+      native_histograms_[index].Record(time);
+    }
+  }
+
+  // Returns nullptr if histograms are off or the index is invalid.
+  const LatencyHistogram *GetNativeHistogram(cell index) const;
+
+  // Counts the statement starting at the specified address and charges the
+  // time since the previous statement to the previous one. Time spent in
+  // natives and other scripts is thus included in the statement that called
+  // them.
+  void CountStatement(cell address, Clock::time_point time);
+
+  // Charges the time since the last statement to it, e.g. when the script
+  // returns to the server.
+  void EndStatement(Clock::time_point time);
+
+  // Writes a table of all called functions sorted by self time. Names of
+  // non-public functions are taken from debug info.
+  void WriteReport(std::ostream &stream,
+                   const std::string &title,
+                   const AMXDebugInfo &debug_info) const;
+
+  // Writes p50/p99/p99.9/max of each called native, one per line, sorted
+  // by p99.
+  void WriteNativeLatencies(std::ostream &stream) const;
+
+ private:
+  struct StatementCounters {
+    StatementCounters();
+
+    unsigned int num_executions;
+    Clock::duration time;
+  };
+
+  void WriteLineReport(std::ostream &stream,
+                       const AMXDebugInfo &debug_info) const;
+
+ private:
+  AMXRef amx_;
+  Clock::time_point start_time_;
+  Counters main_;
+  std::vector<Counters> publics_;
+  std::vector<Counters> natives_;
+  std::vector<LatencyHistogram> native_histograms_;
+  std::unordered_map<cell, Counters> functions_;
+  unsigned int max_lines_;
+  std::vector<StatementCounters> statements_;
+  StatementCounters *last_statement_;
+  Clock::time_point last_statement_time_;
+};
+
+// Per-thread stack of calls being profiled. Time spent in a call is added to
+// its caller's child time when it returns, which is what self time is
+// computed from.
+//
+// Publics and natives are entered and left explicitly. Other functions are
+// only noticed by the debug hook, which sees the script's frame pointer
+// change on the first statement after a call or return, so they're kept
+// track of by their frame instead.
+class AMXProfileStack {
+ public:
+  AMXProfileStack();
+
+  bool IsEmpty() const { return frames_.empty(); }
+  // Drops all frames without recording them, as their counters may be gone
+  // already.
+  void Clear() { frames_.clear(); }
+
+  // Counters may be nullptr, in which case the call is timed (so that it's
+  // not counted towards the caller's self time) but not recorded.
+  void Enter(AMXProfiler::Counters *counters, Clock::time_point time);
+
+  // Leaves the innermost public or native call, along with any functions
+  // called by it that haven't been seen returning.
+  void Leave(Clock::time_point time);
+
+  // Returns true if the function running in the specified frame is the one
+  // on top of the stack (or, for a public function, if no function is), i.e.
+  // nothing has changed since the last call.
+  bool IsCurrentFunction(cell frm, cell return_address) const;
+
+  // Leaves all functions that must have returned if the script is now
+  // running in the specified frame, and enters the function running in it
+  // unless it's the caller of one of them or a public function.
+  void SwitchFunction(cell frm,
+                      cell return_address,
+                      AMXProfiler::Counters *counters,
+                      Clock::time_point time);
+
+ private:
+  static const std::size_t kInitialCapacity = 256;
+
+  struct Frame {
+    AMXProfiler::Counters *counters;
+    Clock::time_point start_time;
+    Clock::duration child_time;  // spent in nested calls
+    cell frm;            // 0 for publics and natives
+    cell return_address;
+  };
+
+  void Push(AMXProfiler::Counters *counters,
+            Clock::time_point time,
+            cell frm,
+            cell return_address);
+  void Pop(Clock::time_point time);
+
+  bool IsFunctionOnTop() const {
+    return !frames_.empty() && frames_.back().frm != 0;
+  }
+
+  std::vector<Frame> frames_;
+};
+
+#endif // !AMXPROFILER_H
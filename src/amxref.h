@@ -46,6 +46,7 @@ class AMXRef {
   void SetCallback(AMX_CALLBACK callback) { amx_SetCallback(amx_, callback); }
 
   bool IsSysreqDEnabled() const { return amx_->sysreq_d != 0; }
+  cell GetSysreqD() const { return amx_->sysreq_d; }
   void SetSysreqDEnabled(bool is_enabled) { amx_->sysreq_d = is_enabled; };
 
   cell GetCip() const { return amx_->cip; }
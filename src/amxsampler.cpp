@@ -0,0 +1,143 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "amxdebuginfo.h"
+#include "amxsampler.h"
+#include "amxstacktrace.h"
+
+namespace {
+
+void AddFrame(AMXSampler::Sample &sample,
+              AMX *amx,
+              AMXSampler::Frame::Type type,
+              cell index_or_address) {
+  if (sample.num_frames < AMXSampler::kMaxFrames) {
+    AMXSampler::Frame &frame = sample.frames[sample.num_frames++];
+    frame.amx = amx;
+    frame.type = type;
+    frame.index = index_or_address;
+  }
+}
+
+} // anonymous namespace
+
+AMXSampler::AMXSampler()
+ : head_(0),
+   tail_(0),
+   num_dropped_(0)
+{
+}
+
+void AMXSampler::Capture(const AMXCallStack &calls,
+                         bool debug_hook_installed) {
+  // The vector behind the stack's indexable view may be in the middle of
+  // being reallocated by the code this handler interrupted.
+  const AMXCall *snapshot;
+  std::size_t depth = calls.GetSnapshot(snapshot);
+  if (depth == 0) {
+    return;
+  }
+  if (depth > AMXCallStack::kMaxSnapshotSize) {
+    // The calls at the top, where the script's registers point to, are not
+    // in the snapshot.
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  std::size_t head = head_.load(std::memory_order_relaxed);
+  std::size_t tail = tail_.load(std::memory_order_acquire);
+  if (head - tail >= kMaxSamples) {
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  Sample &sample = samples_[head % kMaxSamples];
+  sample.num_frames = 0;
+
+  AMX *amx = nullptr;
+  cell frm = 0;
+  cell cip = 0;
+  bool registers_valid = false;
+
+  for (std::size_t i = depth; i > 0; ) {
+    const AMXCall &call = snapshot[--i];
+
+    if (call.amx() != amx) {
+      // The script was either interrupted in a native or this is the top
+      // of the stack; in both cases its registers tell where it is.
+      amx = call.amx();
+      frm = call.amx().GetFrm();
+      cip = call.amx().GetCip();
+      registers_valid = true;
+
+      // The exception is a public function running at the top of the stack
+      // with no debug hook: the interpreter keeps its registers in local
+      // variables and only writes them back on a native call or a BREAK,
+      // so both CIP and FRM are stale. Unwinding from there would produce
+      // bogus frames, so only the public function itself is recorded.
+      if (i == depth - 1 && call.IsPublic() && !debug_hook_installed) {
+        registers_valid = false;
+      }
+    }
+
+    if (call.IsNative()) {
+      AddFrame(sample, amx, Frame::NATIVE, call.index());
+      continue;
+    }
+
+    // The last unwound frame is the public function itself.
+    if (registers_valid) {
+      AMXRawFrame raw_frames[kMaxFrames];
+      int num_raw_frames =
+        UnwindAMXStack(amx, frm, cip, raw_frames, kMaxFrames);
+      for (int j = 0; j < num_raw_frames - 1; j++) {
+        AddFrame(sample, amx, Frame::FUNCTION, raw_frames[j].cip);
+      }
+    }
+    AddFrame(sample, amx, Frame::PUBLIC, call.index());
+
+    frm = call.frm();
+    cip = call.cip();
+    registers_valid = true;
+  }
+
+  head_.store(head + 1, std::memory_order_release);
+}
+
+bool AMXSampler::Read(Sample &sample) {
+  std::size_t tail = tail_.load(std::memory_order_relaxed);
+  std::size_t head = head_.load(std::memory_order_acquire);
+  if (tail == head) {
+    return false;
+  }
+  sample = samples_[tail % kMaxSamples];
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+// static
+AMXSampler &AMXSampler::shared() {
+  static AMXSampler instance;
+  return instance;
+}
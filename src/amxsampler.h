@@ -0,0 +1,91 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef AMXSAMPLER_H
+#define AMXSAMPLER_H
+
+#include <atomic>
+#include <cstddef>
+#include "amxcallstack.h"
+#include "amxref.h"
+
+// Records snapshots of the call stack from a profiling timer's signal
+// handler. Samples are stored as raw addresses in a fixed-size ring that
+// is read (and symbolized) later by a single consumer, so capturing a
+// sample never allocates or locks.
+class AMXSampler {
+ public:
+  static const int kMaxFrames = 64;
+  static const std::size_t kMaxSamples = 512;
+
+  struct Frame {
+    enum Type {
+      NATIVE,   // index is the native's index
+      PUBLIC,   // index is the public's index
+      FUNCTION  // address is somewhere in the function's code
+    };
+
+    AMX *amx;
+    Type type;
+    union {
+      cell index;
+      cell address;
+    };
+  };
+
+  // Frames go from the innermost to the outermost function.
+  struct Sample {
+    int num_frames;
+    Frame frames[kMaxFrames];
+  };
+
+  // Takes a snapshot of the call stack. The position inside of the public
+  // function at the top of the stack is only known when the debug hook is
+  // installed (the VM updates CIP and FRM only on BREAK and native calls),
+  // otherwise it's recorded without its callees. Stacks deeper than the
+  // call stack's snapshot are dropped.
+  void Capture(const AMXCallStack &calls, bool debug_hook_installed);
+
+  // Retrieves the oldest sample. Returns false if the ring is empty.
+  bool Read(Sample &sample);
+
+  // Number of samples lost because the ring was full or the stack was too
+  // deep.
+  unsigned int num_dropped() const { return num_dropped_; }
+
+  static AMXSampler &shared();
+
+ private:
+  AMXSampler();
+  AMXSampler(const AMXSampler &);
+  AMXSampler &operator=(const AMXSampler &);
+
+ private:
+  Sample samples_[kMaxSamples];
+  std::atomic<std::size_t> head_;
+  std::atomic<std::size_t> tail_;
+  std::atomic<unsigned int> num_dropped_;
+};
+
+#endif // !AMXSAMPLER_H
@@ -32,6 +32,7 @@
 #include <string>
 #include <vector>
 #include "amxdebuginfo.h"
+#include "amxlocationcache.h"
 #include "amxopcode.h"
 #include "amxref.h"
 #include "amxstacktrace.h"
@@ -112,13 +113,12 @@ cell GetCallerAddress(AMXRef amx, cell frame_address) {
 AMXStackFrame::AMXStackFrame(AMXRef amx, cell address)
  : amx_(amx),
    address_(0),
+   prev_address_(0),
    return_address_(0),
    callee_address_(0),
    caller_address_(0)
 {
-  if (IsStackAddress(amx_, address)) {
-    address_ = address;
-  }
+  set_address(address);
   if (address_ != 0) {
     return_address_ = GetReturnAddressSafe(amx_, address_);
     if (return_address_ != 0) {
@@ -135,13 +135,12 @@ AMXStackFrame::AMXStackFrame(AMXRef amx,
                              cell caller_address)
  : amx_(amx),
    address_(0),
+   prev_address_(0),
    return_address_(0),
    callee_address_(0),
    caller_address_(0)
 {
-  if (IsStackAddress(amx_, address)) {
-    address_ = address;
-  }
+  set_address(address);
   if (IsCodeAddress(amx_, return_address)) {
     return_address_ = return_address;
   }
@@ -153,69 +152,69 @@ AMXStackFrame::AMXStackFrame(AMXRef amx,
   }
 }
 
-AMXStackFrame AMXStackFrame::GetPrevious() const {
-  return AMXStackFrame(amx_, GetPreviousFrameSafe(amx_, address_));
-}
-
-void AMXStackFrame::Print(std::ostream &stream,
-                          const AMXDebugInfo &debug_info) const {
-  AMXStackFramePrinter printer(stream, debug_info);
-  printer.Print(*this);
-}
-
-AMXStackTrace::AMXStackTrace(AMXRef amx, cell frame, int max_depth)
- : current_frame_(amx, frame),
-   max_depth_(max_depth),
-   frame_index_(0)
+AMXStackFrame::AMXStackFrame(AMXRef amx, const AMXRawFrame &frame)
+ : amx_(amx),
+   address_(0),
+   prev_address_(0),
+   return_address_(0),
+   callee_address_(0),
+   caller_address_(0)
 {
+  // Link to frame.frm directly: for the innermost frame there's no stack
+  // slot pointing to it, its frame pointer lives only in the FRM register.
+  if (IsStackAddress(amx_, frame.frm)) {
+    prev_address_ = frame.frm;
+  }
+  if (IsCodeAddress(amx_, frame.cip)) {
+    return_address_ = frame.cip;
+    callee_address_ = GetCalleeAddressSafe(amx_, return_address_);
+    if (prev_address_ != 0) {
+      cell return_address = GetReturnAddressSafe(amx_, prev_address_);
+      if (return_address != 0) {
+        caller_address_ = GetCalleeAddressSafe(amx_, return_address);
+      }
+    }
+  }
 }
 
-bool AMXStackTrace::MoveNext() {
-  if (frame_index_ < max_depth_) {
-    current_frame_ = current_frame_.GetPrevious();
-    frame_index_++;
-    return true;
+void AMXStackFrame::set_address(cell address) {
+  address_ = 0;
+  prev_address_ = 0;
+  if (IsStackAddress(amx_, address)) {
+    address_ = address;
+    prev_address_ = GetPreviousFrameSafe(amx_, address_);
   }
-  return false;
 }
 
-AMXStackTrace GetAMXStackTrace(AMXRef amx,
-                               cell frm,
-                               cell cip,
-                               int max_depth) {
-  // Use a fake frame, hopefully without clobbering anything in silly code.
-  cell stk = amx.GetStk();
-  cell hlw = amx.GetHea();
-  if (amx.CheckStack()
-      && amx.GetStackSpaceLeft() >= static_cast<cell>((2 * sizeof(cell)))) {
-    amx.SetStk(hlw + (2 * sizeof(cell)));
-    amx.PushStack(cip);
-    amx.PushStack(frm);
-    amx.SetFrm(hlw);
-  }
+AMXStackFrame AMXStackFrame::GetPrevious() const {
+  return AMXStackFrame(amx_, prev_address_);
+}
 
-  AMXStackTrace trace(amx, amx.GetFrm(), max_depth);
+void AMXStackFrame::Print(std::ostream &stream,
+                          const AMXDebugInfo &debug_info,
+                          AMXLocationCache *location_cache) const {
+  AMXStackFramePrinter printer(stream, debug_info, location_cache);
+  printer.Print(*this);
+}
 
-  if (amx.CheckStack()) {
-    amx.SetStk(stk);
-    amx.SetFrm(frm);
+int UnwindAMXStack(AMXRef amx,
+                   cell frm,
+                   cell cip,
+                   AMXRawFrame *frames,
+                   int max_frames) {
+  int num_frames = 0;
+  while (num_frames < max_frames && cip != 0 && IsCodeAddress(amx, cip)) {
+    frames[num_frames].frm = frm;
+    frames[num_frames].cip = cip;
+    num_frames++;
+    cip = GetReturnAddressSafe(amx, frm);
+    frm = GetPreviousFrameSafe(amx, frm);
   }
-
-  return trace;
+  return num_frames;
 }
 
 namespace {
 
-class IsArgumentOf : public std::unary_function<AMXDebugSymbol, bool> {
- public:
-  IsArgumentOf(cell function_address) : function_address_(function_address) {}
-  bool operator()(AMXDebugSymbol symbol) const {
-    return symbol.IsLocal() && symbol.GetCodeStart() == function_address_;
-  }
- private:
-  cell function_address_;
-};
-
 cell GetArgumentValue(AMXRef amx, cell frame_address, int index) {
   cell arg_address = frame_address + (3 + index) * sizeof(cell);
   return *reinterpret_cast<cell*>(amx.GetData() + arg_address);
@@ -414,9 +413,11 @@ std::vector<cell> GetStateIDs(AMXRef amx,
 } // anonymous namespace
 
 AMXStackFramePrinter::AMXStackFramePrinter(std::ostream &stream,
-                                           const AMXDebugInfo &debug_info)
+                                           const AMXDebugInfo &debug_info,
+                                           AMXLocationCache *location_cache)
   : stream_(stream),
-    debug_info_(debug_info)
+    debug_info_(debug_info),
+    location_cache_(location_cache)
 {
 }
 
@@ -455,6 +456,20 @@ void AMXStackFramePrinter::PrintReturnAddress(const AMXStackFrame &frame) {
 }
 
 void AMXStackFramePrinter::PrintCallerName(const AMXStackFrame &frame) {
+  if (location_cache_ != nullptr) {
+    std::string name;
+    if (!location_cache_->Get(
+          AMXLocationCache::CallerName, frame.caller_address(), name)) {
+      std::stringstream stream;
+      AMXStackFramePrinter(stream, debug_info_).PrintCallerName(frame);
+      name = stream.str();
+      location_cache_->Put(
+        AMXLocationCache::CallerName, frame.caller_address(), name);
+    }
+    stream_ << name;
+    return;
+  }
+
   if (IsMain(frame.amx(), frame.caller_address())) {
     stream_ << "main";
     return;
@@ -612,7 +627,6 @@ void AMXStackFramePrinter::PrintArgumentList(const AMXStackFrame &frame) {
                                           frame.return_address());
   }
 
-  std::vector<AMXDebugSymbol> args;
   cell num_actual_args = GetNumArguments(frame.amx(), prev_frame.address());
   if (num_actual_args < 0) {
     // For better compatibility with YSI, if the the count is negative use
@@ -622,13 +636,7 @@ void AMXStackFramePrinter::PrintArgumentList(const AMXStackFrame &frame) {
   }
   cell num_printed_args = std::min(10, num_actual_args);
 
-  if (debug_info_.IsLoaded()) {
-    std::remove_copy_if(debug_info_.GetSymbols().begin(),
-                        debug_info_.GetSymbols().end(),
-                        std::back_inserter(args),
-                        std::not1(IsArgumentOf(func_address)));
-    std::sort(args.begin(), args.end());
-  }
+  AMXDebugInfo::SymbolTable args = debug_info_.GetArguments(func_address);
 
   // Print a comma-separated list of arguments and their values. If debug
   // info is not available argument names are omitted (only their values
@@ -681,6 +689,19 @@ void AMXStackFramePrinter::PrintState(const AMXStackFrame &frame) {
 }
 
 void AMXStackFramePrinter::PrintSourceLocation(cell address) {
+  if (location_cache_ != nullptr) {
+    std::string location;
+    if (!location_cache_->Get(
+          AMXLocationCache::SourceLocation, address, location)) {
+      std::stringstream stream;
+      AMXStackFramePrinter(stream, debug_info_).PrintSourceLocation(address);
+      location = stream.str();
+      location_cache_->Put(AMXLocationCache::SourceLocation, address, location);
+    }
+    stream_ << location;
+    return;
+  }
+
   std::string filename = debug_info_.GetFileName(address);
   if (filename.empty()) {
     filename.assign("<unknown file>");
@@ -29,11 +29,22 @@
 #include "amxref.h"
 
 class AMXDebugInfo;
+class AMXLocationCache;
+
+// A frame as seen by the unwinder: the function's frame pointer and the
+// code address at which it is currently executing (for callers this is the
+// return address of the call to the next frame).
+struct AMXRawFrame {
+  cell frm;
+  cell cip;
+};
 
 class AMXStackFrame {
  public:
   AMXStackFrame(AMXRef amx, cell address);
 
+  AMXStackFrame(AMXRef amx, const AMXRawFrame &frame);
+
   AMXStackFrame(AMXRef amx,
                 cell address,
                 cell return_address,
@@ -45,9 +56,7 @@ class AMXStackFrame {
 
   cell address() const { return address_; }
 
-  void set_address(cell address) {
-    address_ = address; 
-  }
+  void set_address(cell address);
 
   cell return_address() const {return return_address_; }
 
@@ -69,41 +78,34 @@ class AMXStackFrame {
 
   AMXStackFrame GetPrevious() const;
 
-  void Print(std::ostream &stream, const AMXDebugInfo &debug_info) const;
+  void Print(std::ostream &stream,
+             const AMXDebugInfo &debug_info,
+             AMXLocationCache *location_cache = nullptr) const;
 
  private:
   AMXRef amx_;
   cell address_;
+  cell prev_address_;
   cell return_address_;
   cell callee_address_;
   cell caller_address_;
 };
 
-class AMXStackTrace {
- public:
-  AMXStackTrace(AMXRef amx, cell frame, int max_depth);
-
-  bool MoveNext();
-
-  const AMXStackFrame &current_frame() const {
-    return current_frame_;
-  }
-
- private:
-  AMXStackFrame current_frame_;
-  int max_depth_;
-  int frame_index_;
-};
-
-AMXStackTrace GetAMXStackTrace(AMXRef amx,
-                               cell frm,
-                               cell cip,
-                               int max_depth);
+// Walks the stack starting at the function whose frame is frm and that is
+// executing at cip, and stores up to max_frames frames into frames (the
+// innermost one first). Returns the number of frames stored. This only reads
+// AMX memory, so it's safe to call on a script that is being executed.
+int UnwindAMXStack(AMXRef amx,
+                   cell frm,
+                   cell cip,
+                   AMXRawFrame *frames,
+                   int max_frames);
 
 class AMXStackFramePrinter {
  public:
   AMXStackFramePrinter(std::ostream &stream,
-                       const AMXDebugInfo &debug_info);
+                       const AMXDebugInfo &debug_info,
+                       AMXLocationCache *location_cache = nullptr);
 
   void Print(const AMXStackFrame &frame);
 
@@ -135,6 +137,7 @@ class AMXStackFramePrinter {
  private:
   std::ostream &stream_;
   const AMXDebugInfo &debug_info_;
+  AMXLocationCache *location_cache_;
 };
 
 #endif // !AMXSTACKTRACE_H
@@ -0,0 +1,192 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdio>
+#include <list>
+#include <string>
+#include <vector>
+#include <amx/amx.h>
+#include "amxdebuginfo.h"
+#include "amxsymbolfinder.h"
+#include "fileutils.h"
+
+namespace {
+
+// 64-bit FNV-1a, same as AMXDebugInfo::GetHeaderHash().
+void HashBytes(const unsigned char *bytes, std::size_t size, uint64_t &hash) {
+  for (std::size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+}
+
+} // anonymous namespace
+
+void AMXSymbolFinder::AddSearchPath(const std::string &path) {
+  search_paths_.push_back(path);
+}
+
+std::string AMXSymbolFinder::Find(AMX *amx, const std::string &amx_path) {
+  uint64_t header_hash =
+    AMXDebugInfo::GetHeaderHash(reinterpret_cast<AMX_HEADER*>(amx->base));
+
+  // The code is relocated when the script is loaded, so it has to be read
+  // from the file rather than from memory.
+  const SymbolFile *script = nullptr;
+  if (!amx_path.empty()) {
+    script = GetSymbolFile(amx_path);
+    if (script != nullptr && script->header_hash != header_hash) {
+      // The file has been replaced since the script was loaded.
+      script = nullptr;
+    }
+  }
+
+  std::string match;
+  int num_matches = 0;
+
+  for (std::list<std::string>::const_iterator dir_it = search_paths_.begin();
+       dir_it != search_paths_.end(); ++dir_it) {
+    const Directory &dir = GetDirectory(*dir_it);
+
+    for (std::vector<std::string>::const_iterator file_it = dir.files.begin();
+         file_it != dir.files.end(); ++file_it) {
+      std::string path;
+      path.append(*dir_it);
+      path.append(fileutils::kNativePathSepString);
+      path.append(*file_it);
+
+      const SymbolFile *file = GetSymbolFile(path);
+      if (file == nullptr
+          || !file->has_debug_info
+          || file->header_hash != header_hash) {
+        continue;
+      }
+      if (script != nullptr) {
+        if (file->code_hash == script->code_hash) {
+          return path;
+        }
+        continue;
+      }
+      if (num_matches++ == 0) {
+        match = path;
+      }
+    }
+  }
+
+  if (num_matches != 1) {
+    // Scripts with identical headers are not that unlikely (e.g. different
+    // versions of a script with the same sizes), better not guess.
+    return std::string();
+  }
+  return match;
+}
+
+const AMXSymbolFinder::SymbolFile *AMXSymbolFinder::GetSymbolFile(
+  const std::string &path)
+{
+  // Only read the file if it's new or has changed since the last time.
+  long long mtime = fileutils::GetModificationTimeNs(path);
+  SymbolFileMap::iterator it = symbol_files_.find(path);
+  if (it != symbol_files_.end() && it->second.mtime == mtime) {
+    return &it->second;
+  }
+
+  SymbolFile file;
+  if (!ReadSymbolFile(path, file)) {
+    if (it != symbol_files_.end()) {
+      symbol_files_.erase(it);
+    }
+    return nullptr;
+  }
+  file.mtime = mtime;
+  return &(symbol_files_[path] = file);
+}
+
+const AMXSymbolFinder::Directory &AMXSymbolFinder::GetDirectory(
+  const std::string &path)
+{
+  long long mtime = fileutils::GetModificationTimeNs(path);
+  DirectoryMap::iterator it = directories_.find(path);
+  if (it == directories_.end()) {
+    it = directories_.insert(std::make_pair(path, Directory())).first;
+  } else if (it->second.mtime == mtime) {
+    return it->second;
+  }
+
+  Directory &dir = it->second;
+  dir.mtime = mtime;
+  dir.files.clear();
+  fileutils::GetDirectoryFiles(path, "*.amx", dir.files);
+  return dir;
+}
+
+// static
+bool AMXSymbolFinder::ReadSymbolFile(const std::string &path,
+                                     SymbolFile &file) {
+  std::FILE *fp = std::fopen(path.c_str(), "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+
+  AMX_HEADER header;
+  bool ok = std::fread(&header, 1, sizeof(header), fp) == sizeof(header)
+         && header.magic == AMX_MAGIC
+         && header.cod >= static_cast<int32_t>(sizeof(header))
+         && header.dat >= header.cod
+         && header.size >= header.dat
+         && std::fseek(fp, header.cod, SEEK_SET) == 0;
+
+  uint64_t code_hash = 14695981039346656037ULL;
+  if (ok) {
+    std::size_t code_size = header.dat - header.cod;
+    unsigned char buffer[4096];
+    while (code_size > 0) {
+      std::size_t chunk_size = code_size < sizeof(buffer)
+                             ? code_size
+                             : sizeof(buffer);
+      if (std::fread(buffer, 1, chunk_size, fp) != chunk_size) {
+        ok = false;
+        break;
+      }
+      HashBytes(buffer, chunk_size, code_hash);
+      code_size -= chunk_size;
+    }
+  }
+  std::fclose(fp);
+
+  if (!ok) {
+    return false;
+  }
+
+  file.has_debug_info = (header.flags & AMX_FLAG_DEBUG) != 0;
+  file.header_hash = AMXDebugInfo::GetHeaderHash(&header);
+  file.code_hash = code_hash;
+  return true;
+}
+
+// static
+AMXSymbolFinder &AMXSymbolFinder::shared() {
+  static AMXSymbolFinder instance;
+  return instance;
+}
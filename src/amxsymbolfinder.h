@@ -0,0 +1,78 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef AMXSYMBOLFINDER_H
+#define AMXSYMBOLFINDER_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <amx/amx.h>
+
+// Finds detached debug info for scripts that were compiled with debug info
+// but deployed without it. A symbol file is simply the original .amx file
+// and is matched to a script by its header and code section.
+class AMXSymbolFinder {
+ public:
+  void AddSearchPath(const std::string &path);
+
+  // amx_path is the script's own .amx file. Its code section is compared
+  // with that of symbol files; if it's not known, only headers are compared
+  // and the symbol file is only used if there is exactly one match.
+  std::string Find(AMX *amx, const std::string &amx_path);
+
+  static AMXSymbolFinder &shared();
+
+ private:
+  struct SymbolFile {
+    long long mtime;
+    bool has_debug_info;
+    uint64_t header_hash;
+    uint64_t code_hash;
+  };
+
+  struct Directory {
+    long long mtime;
+    std::vector<std::string> files;
+  };
+
+  const SymbolFile *GetSymbolFile(const std::string &path);
+  const Directory &GetDirectory(const std::string &path);
+
+  static bool ReadSymbolFile(const std::string &path, SymbolFile &file);
+
+ private:
+  std::list<std::string> search_paths_;
+
+  typedef std::map<std::string, SymbolFile> SymbolFileMap;
+  SymbolFileMap symbol_files_;
+
+  // Directory listings are cached until the directory's modification time
+  // changes, i.e. until files are added, removed or renamed.
+  typedef std::map<std::string, Directory> DirectoryMap;
+  DirectoryMap directories_;
+};
+
+#endif // !AMXSYMBOLFINDER_H
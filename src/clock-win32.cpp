@@ -0,0 +1,59 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <intrin.h>
+#include <windows.h>
+
+#include "clock.h"
+
+// static
+Clock::time_point Clock::CoarseNow() {
+  // GetTickCount64() is not available on XP, so extend the 32-bit tick
+  // count manually. It wraps around every 49.7 days.
+  static DWORD last_ticks = 0;
+  static uint64_t high_ticks = 0;
+
+  DWORD ticks = GetTickCount();
+  if (ticks < last_ticks) {
+    high_ticks += static_cast<uint64_t>(1) << 32;
+  }
+  last_ticks = ticks;
+  return time_point(std::chrono::milliseconds(high_ticks + ticks));
+}
+
+// static
+bool Clock::HasInvariantTSC() {
+  int info[4];
+  __cpuid(info, 0x80000000);
+  if (static_cast<unsigned int>(info[0]) < 0x80000007) {
+    return false;
+  }
+  __cpuid(info, 0x80000007);
+  return (info[3] & (1 << 8)) != 0;
+}
+
+// static
+uint64_t Clock::ReadTSC() {
+  return __rdtsc();
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <thread>
+#include "clock.h"
+
+// static
+Clock::Type Clock::type_ = Clock::PRECISE;
+
+// static
+uint64_t Clock::tsc_base_ = 0;
+
+// static
+double Clock::tsc_period_ = 0.0;
+
+// static
+Clock::time_point Clock::now() {
+  switch (type_) {
+    case COARSE:
+      return CoarseNow();
+    case TSC:
+      return time_point(duration(
+        static_cast<rep>((ReadTSC() - tsc_base_) * tsc_period_)));
+    default:
+      return PreciseNow();
+  }
+}
+
+// static
+bool Clock::SetType(Type type) {
+  if (type == TSC) {
+    if (!HasInvariantTSC()) {
+      return false;
+    }
+    CalibrateTSC();
+  }
+  type_ = type;
+  return true;
+}
+
+// static
+bool Clock::TypeFromString(const std::string &s, Type &type) {
+  if (s == "precise") {
+    type = PRECISE;
+  } else if (s == "coarse") {
+    type = COARSE;
+  } else if (s == "tsc") {
+    type = TSC;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// static
+const char *Clock::TypeToString(Type type) {
+  switch (type) {
+    case COARSE:
+      return "coarse";
+    case TSC:
+      return "tsc";
+    default:
+      return "precise";
+  }
+}
+
+// static
+Clock::time_point Clock::PreciseNow() {
+  return time_point(std::chrono::duration_cast<duration>(
+    std::chrono::steady_clock::now().time_since_epoch()));
+}
+
+// static
+void Clock::CalibrateTSC() {
+  // Count TSC ticks over a short interval of the precise clock. 20 ms is
+  // enough to get the frequency within a few ppm without delaying the
+  // server start noticeably.
+  time_point start_time = PreciseNow();
+  uint64_t start_tsc = ReadTSC();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  uint64_t end_tsc = ReadTSC();
+  time_point end_time = PreciseNow();
+
+  duration elapsed = end_time - start_time;
+  tsc_period_ = static_cast<double>(elapsed.count())
+              / static_cast<double>(end_tsc - start_tsc);
+  tsc_base_ = start_tsc;
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <chrono>
+#include <string>
+#include <stdint.h>
+
+// A monotonic clock with a selectable time source, used for all timing done
+// by the plugin. It meets the std::chrono clock requirements so time points
+// and durations can be mixed with the standard ones.
+//
+//   PRECISE - std::chrono::steady_clock
+//   COARSE  - CLOCK_MONOTONIC_COARSE (GetTickCount() on Windows); a few
+//             milliseconds of resolution but much cheaper to read
+//   TSC     - the CPU's time stamp counter, calibrated against the precise
+//             clock on startup; only used if the TSC is invariant
+class Clock {
+ public:
+  enum Type {
+    PRECISE,
+    COARSE,
+    TSC
+  };
+
+  typedef std::chrono::nanoseconds duration;
+  typedef duration::rep rep;
+  typedef duration::period period;
+  typedef std::chrono::time_point<Clock, duration> time_point;
+
+  static const bool is_steady = true;
+
+  static time_point now();
+
+  static Type type() { return type_; }
+  static bool SetType(Type type);
+
+  static bool TypeFromString(const std::string &s, Type &type);
+  static const char *TypeToString(Type type);
+
+ private:
+  static time_point PreciseNow();
+  static time_point CoarseNow();
+
+  static bool HasInvariantTSC();
+  static uint64_t ReadTSC();
+  static void CalibrateTSC();
+
+ private:
+  static Type type_;
+  static uint64_t tsc_base_;
+  static double tsc_period_;
+};
+
+#endif // !CLOCK_H
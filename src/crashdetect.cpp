@@ -22,8 +22,10 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
@@ -34,10 +36,15 @@
 #include <amx/amxaux.h>
 #include "amxcallstack.h"
 #include "amxdebuginfo.h"
+#include "amxdebuginfocache.h"
+#include "amxnativethunks.h"
 #include "amxopcode.h"
 #include "amxpathfinder.h"
+#include "amxprofiler.h"
 #include "amxref.h"
 #include "amxstacktrace.h"
+#include "amxsymbolfinder.h"
+#include "clock.h"
 #include "crashdetect.h"
 #include "fileutils.h"
 #include "log.h"
@@ -51,6 +58,9 @@
 
 namespace {
 
+// Maximum number of script frames printed per public function in a backtrace.
+const int kMaxBacktraceFrames = 100;
+
 template<typename Printer>
 class PrintLine: public std::unary_function<const std::string &, void> {
  public:
@@ -69,42 +79,270 @@ void PrintStream(Printer printer, const std::stringstream &stream) {
                            PrintLine<Printer>(printer));
 }
 
+template<unsigned int Features>
+int AMXAPI DebugHook(AMX *amx) {
+  return CrashDetect::GetHandler(amx)->OnDebugHook<Features>();
+}
+
+template<unsigned int Features>
+int AMXAPI Callback(AMX *amx, cell index, cell *result, cell *params) {
+  CrashDetect *handler = CrashDetect::GetHandler(amx);
+  return handler->OnCallback<Features>(index, result, params);
+}
+
+template<unsigned int Features>
+int AMXAPI Exec(AMX *amx, cell *retval, int index) {
+  if (amx->flags & AMX_FLAG_BROWSE) {
+    return amx_Exec(amx, retval, index);
+  }
+  CrashDetect *handler = CrashDetect::GetHandler(amx);
+  if (handler == nullptr) {
+    return amx_Exec(amx, retval, index);
+  }
+  return handler->OnExec<Features>(retval, index);
+}
+
+struct HookSet {
+  AMX_DEBUG debug_hook;
+  AMX_CALLBACK callback;
+  CrashDetect::AMX_EXEC exec;
+};
+
+#define HOOK_SET(f) {DebugHook<f>, Callback<f>, Exec<f>}
+#define HOOK_SETS_4(f) \
+  HOOK_SET(f), HOOK_SET(f + 1), HOOK_SET(f + 2), HOOK_SET(f + 3)
+#define HOOK_SETS_32(f) \
+  HOOK_SETS_4(f + 0x00), HOOK_SETS_4(f + 0x04), \
+  HOOK_SETS_4(f + 0x08), HOOK_SETS_4(f + 0x0C), \
+  HOOK_SETS_4(f + 0x10), HOOK_SETS_4(f + 0x14), \
+  HOOK_SETS_4(f + 0x18), HOOK_SETS_4(f + 0x1C)
+
+// One set of hooks for each combination of CrashDetect::HookFeatures.
+const HookSet hook_sets[CrashDetect::HOOK_ALL + 1] = {
+  HOOK_SETS_32(0x00), HOOK_SETS_32(0x20)
+};
+
+#undef HOOK_SETS_32
+#undef HOOK_SETS_4
+#undef HOOK_SET
+
 } // anonymous namespace
 
-AMXCallStack CrashDetect::call_stack_;
+std::atomic<unsigned int> CrashDetect::hook_features_;
+std::atomic<bool> CrashDetect::debug_hook_needed_;
+
+std::atomic<CrashDetect::ThreadState*> CrashDetect::thread_states_;
+thread_local CrashDetect::ThreadState *CrashDetect::thread_state_;
 
 unsigned int CrashDetect::long_call_time_;
+unsigned int CrashDetect::trace_buffer_size_;
+bool CrashDetect::profile_functions_;
+bool CrashDetect::profile_lines_;
+CrashDetect::ThreadState *CrashDetect::sampled_thread_state_;
+std::map<std::string, unsigned long> CrashDetect::sampled_stacks_;
+Clock::time_point CrashDetect::samples_next_write_;
 std::chrono::microseconds CrashDetect::long_call_time_current_;
-std::chrono::high_resolution_clock::time_point CrashDetect::long_call_time_next_;
 bool CrashDetect::long_call_time_running_;
 
+std::thread CrashDetect::warmup_thread_;
+std::mutex CrashDetect::warmup_mutex_;
+std::condition_variable CrashDetect::warmup_cond_;
+std::deque<CrashDetect*> CrashDetect::warmup_queue_;
+CrashDetect *CrashDetect::warmup_current_;
+bool CrashDetect::warmup_stop_;
+
 CrashDetect::CrashDetect(AMX *amx)
   : AMXHandler<CrashDetect>(amx),
     amx_(amx),
+    debug_info_pending_(false),
+    location_cache_(Options::shared().location_cache_size()),
     prev_debug_(nullptr),
     prev_callback_(nullptr),
     last_frame_(amx->stp),
     block_exec_errors_(false),
-    address_naught_(false)
+    address_naught_(false),
+    sysreq_d_(0),
+    fast_natives_(false),
+    out_of_thunks_(false),
+    unpatch_natives_pending_(false)
 {
 }
 
+AMX_DEBUG CrashDetect::debug_hook() const {
+  if (!debug_hook_needed_.load(std::memory_order_relaxed)) {
+    return prev_debug_;
+  }
+  return hook_sets[hook_features_.load(std::memory_order_relaxed)].debug_hook;
+}
+
+// static
+AMX_CALLBACK CrashDetect::callback() {
+  return hook_sets[hook_features_.load(std::memory_order_relaxed)].callback;
+}
+
+// static
+CrashDetect::AMX_EXEC CrashDetect::exec_hook() {
+  return hook_sets[hook_features_.load(std::memory_order_relaxed)].exec;
+}
+
+// static
+unsigned int CrashDetect::GetHookFeatures() {
+  unsigned int features = Options::shared().trace_flags()
+    & (HOOK_TRACE_NATIVES | HOOK_TRACE_PUBLICS | HOOK_TRACE_FUNCTIONS);
+  if (Options::shared().trace_filter() != nullptr) {
+    features |= HOOK_TRACE_FILTER;
+  }
+  if (long_call_time_ != 0) {
+    features |= HOOK_LONG_CALL;
+  }
+  if (Options::shared().profiler()) {
+    features |= HOOK_PROFILE;
+  }
+  return features;
+}
+
+// static
+bool CrashDetect::IsDebugHookNeeded(unsigned int features) {
+  // The VM only checks for long calls in BREAK when there's a debug hook.
+  return (features & HOOK_TRACE_FUNCTIONS) != 0
+    || ((features & HOOK_PROFILE) != 0
+        && (profile_functions_ || profile_lines_))
+    || long_call_time_running_;
+}
+
+// static
+void CrashDetect::UpdateHooks() {
+  unsigned int old_features = hook_features_.load();
+  unsigned int new_features = GetHookFeatures();
+  bool old_debug_hook_needed = debug_hook_needed_.load();
+  bool new_debug_hook_needed = IsDebugHookNeeded(new_features);
+  if (new_features == old_features
+      && new_debug_hook_needed == old_debug_hook_needed) {
+    return;
+  }
+
+  const HookSet &old_hooks = hook_sets[old_features];
+  const HookSet &new_hooks = hook_sets[new_features];
+
+  // This switches the exec hook for all scripts at once.
+  hook_features_.store(new_features);
+  debug_hook_needed_.store(new_debug_hook_needed);
+
+  // Natives called through thunks bypass the callback, so they have to go
+  // back to SYSREQ.C for the new hooks to see them. The scripts may be
+  // running on other threads right now, so this is left to OnExec().
+  bool unpatch_natives =
+    (new_features & ~old_features & (HOOK_TRACE_NATIVES | HOOK_PROFILE)) != 0;
+
+  ForEachHandler([&](CrashDetect *handler) {
+    if (unpatch_natives) {
+      handler->unpatch_natives_pending_.store(true,
+                                              std::memory_order_release);
+    }
+    // Don't touch the hooks if another plugin has put its own on top of
+    // ours: it will keep calling the old variant, which still works.
+    AMX_DEBUG old_debug_hook = old_debug_hook_needed
+      ? old_hooks.debug_hook
+      : handler->prev_debug_;
+    if (handler->amx_.GetDebugHook() == old_debug_hook) {
+      amx_SetDebugHook(handler->amx(), handler->debug_hook());
+    }
+    if (handler->amx_.GetCallback() == old_hooks.callback) {
+      amx_SetCallback(handler->amx(), new_hooks.callback);
+    }
+  });
+}
+
 void CrashDetect::PluginLoad() {
+  Clock::Type clock_type = Clock::PRECISE;
+  if (!Clock::TypeFromString(Options::shared().clock_type(), clock_type)) {
+    LogDebugPrint("Unknown clock type \"%s\", using precise clock",
+                  Options::shared().clock_type().c_str());
+  } else if (!Clock::SetType(clock_type)) {
+    LogDebugPrint("Clock type \"%s\" is not supported, using precise clock",
+                  Clock::TypeToString(clock_type));
+  }
+
   long_call_time_ = Options::shared().long_call_time();
   long_call_time_current_ = std::chrono::microseconds(long_call_time_);
-  long_call_time_next_ = std::chrono::high_resolution_clock::time_point::max();
   long_call_time_running_ = long_call_time_ != 0;
+
+  trace_buffer_size_ = Options::shared().trace_buffer_size();
+  profile_functions_ = Options::shared().profiler_functions();
+  profile_lines_ = Options::shared().profiler_lines() != 0;
+
+  hook_features_ = GetHookFeatures();
+  debug_hook_needed_ = IsDebugHookNeeded(hook_features_);
+  AMXNativeThunks::shared().SetHandler(CallNative);
+
+  if (Options::shared().lazy_debug_info()
+      && Options::shared().debug_info_warmup()) {
+    warmup_stop_ = false;
+    warmup_thread_ = std::thread(WarmUpDebugInfo);
+  }
+
+  // Only the thread that loads the plugin (the server's main thread) is
+  // sampled.
+  if (unsigned int interval = Options::shared().sampling_profiler()) {
+    AMXSampler::shared();
+    sampled_thread_state_ = &thread_state();
+    samples_next_write_ = Clock::time_point::max();
+    if (unsigned int write_interval = Options::shared().profiler_interval()) {
+      samples_next_write_ =
+        Clock::now() + std::chrono::seconds(write_interval);
+    }
+    os::SetProfileTimer(OnProfileTimer, interval);
+  }
 }
 
 void CrashDetect::PluginUnload() {
   long_call_time_running_ = false;
+
+  if (sampled_thread_state_ != nullptr) {
+    os::SetProfileTimer(nullptr, 0);
+    ProcessSamples();
+    WriteSamples();
+    if (unsigned int num_dropped = AMXSampler::shared().num_dropped()) {
+      LogDebugPrint("Sampling profiler dropped %u samples", num_dropped);
+    }
+    sampled_thread_state_ = nullptr;
+  }
+
+  if (warmup_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(warmup_mutex_);
+      warmup_stop_ = true;
+      warmup_queue_.clear();
+    }
+    warmup_cond_.notify_all();
+    warmup_thread_.join();
+  }
+
+  AMXDebugInfoCache::shared().Clear();
 }
 
 int CrashDetect::Load() {
   amx_path_ = AMXPathFinder::shared().Find(amx());
-  if (!amx_path_.empty()) {
-    if (AMXDebugInfo::IsPresent(amx())) {
-      debug_info_.Load(amx_path_);
+  if (!amx_path_.empty() && AMXDebugInfo::IsPresent(amx())) {
+    debug_info_path_ = amx_path_;
+  } else {
+    // The script may have been stripped of debug info, try to find the
+    // original .amx file.
+    debug_info_path_ = AMXSymbolFinder::shared().Find(amx(), amx_path_);
+  }
+
+  if (!debug_info_path_.empty()) {
+    if (Options::shared().lazy_debug_info()) {
+      // Delay loading until debug info is actually needed or the warm-up
+      // thread gets to it.
+      debug_info_pending_ = true;
+      if (warmup_thread_.joinable()) {
+        std::lock_guard<std::mutex> lock(warmup_mutex_);
+        warmup_queue_.push_back(this);
+        warmup_cond_.notify_all();
+      }
+    } else {
+      debug_info_ = AMXDebugInfoCache::shared().Get(amx(), debug_info_path_);
     }
   }
 
@@ -114,7 +352,36 @@ int CrashDetect::Load() {
     amx_name_ = "<unknown>";
   }
 
+  // Natives must go through amx->callback, otherwise they wouldn't show up
+  // in backtraces. In fast mode OnCallback() patches each call site to
+  // SYSREQ.D with a thunk that does the bookkeeping instead.
+  sysreq_d_ = amx_.GetSysreqD();
+  fast_natives_ = Options::shared().fast_natives() && sysreq_d_ != 0;
   amx_.SetSysreqDEnabled(false);
+
+  // If trace_natives is set, only the natives it matches are traced and
+  // recorded in the call stack; the rest are passed straight through.
+  const RegExp *trace_natives = Options::shared().trace_natives();
+  if (trace_natives != nullptr) {
+    int num_natives = amx_.GetNumNatives();
+    instrumented_natives_.resize(num_natives);
+    for (int i = 0; i < num_natives; i++) {
+      const char *name = amx_.GetNativeName(i);
+      instrumented_natives_[i] = name != nullptr && trace_natives->Test(name);
+    }
+  }
+
+  if (Options::shared().profiler()) {
+    profiler_.reset(
+      new AMXProfiler(amx_,
+                      Options::shared().profiler_lines(),
+                      Options::shared().profiler_histograms()));
+    profiler_next_write_ = Clock::time_point::max();
+    if (unsigned int interval = Options::shared().profiler_interval()) {
+      profiler_next_write_ = Clock::now() + std::chrono::seconds(interval);
+    }
+  }
+
   prev_debug_ = amx_.GetDebugHook();
   prev_callback_ = amx_.GetCallback();
 
@@ -122,62 +389,204 @@ int CrashDetect::Load() {
 }
 
 int CrashDetect::Unload() {
+  if (warmup_thread_.joinable()) {
+    // Make sure the warm-up thread doesn't touch this instance anymore.
+    std::unique_lock<std::mutex> lock(warmup_mutex_);
+    warmup_queue_.erase(
+      std::remove(warmup_queue_.begin(), warmup_queue_.end(), this),
+      warmup_queue_.end());
+    while (warmup_current_ == this) {
+      warmup_cond_.wait(lock);
+    }
+  }
+
+  AMXNativeThunks::shared().Release(amx());
+
+  if (profiler_) {
+    WriteProfile();
+    PrintNativeLatencies();
+  }
+
+  // Samples refer to scripts by their AMX pointer, so symbolize them while
+  // this one is still around.
+  if (sampled_thread_state_ != nullptr) {
+    ProcessSamples();
+  }
+
+  // Don't leave records pointing to this script in the trace buffer.
+  ThreadState &state = thread_state();
+  if (!state.public_calls.empty()) {
+    FlushPublicCalls(state, Options::shared().trace_filter() != nullptr);
+  }
+
+  // Everything above needs debug info to name functions and lines. The
+  // cached debug info is dropped once no other script uses it.
+  AMXDebugInfoCache::shared().Release(debug_info_);
   return AMX_ERR_NONE;
 }
 
+AMXLocationCache *CrashDetect::location_cache() {
+  if (location_cache_.size() == 0) {
+    return nullptr;
+  }
+  return &location_cache_;
+}
+
+const AMXDebugInfo &CrashDetect::debug_info() {
+  static const AMXDebugInfo no_debug_info;
+  if (debug_info_pending_) {
+    LoadDebugInfo();
+  }
+  if (debug_info_ == nullptr) {
+    return no_debug_info;
+  }
+  return *debug_info_;
+}
+
+// Same as debug_info() but never loads anything (and therefore never blocks
+// or allocates).
+const AMXDebugInfo &CrashDetect::loaded_debug_info() const {
+  static const AMXDebugInfo no_debug_info;
+  // LoadDebugInfo() clears debug_info_pending_ only after debug_info_ is set.
+  if (debug_info_pending_ || debug_info_ == nullptr) {
+    return no_debug_info;
+  }
+  return *debug_info_;
+}
+
+void CrashDetect::LoadDebugInfo() {
+  std::lock_guard<std::mutex> lock(debug_info_mutex_);
+  if (debug_info_pending_) {
+    debug_info_ = AMXDebugInfoCache::shared().Get(amx(), debug_info_path_);
+    debug_info_pending_ = false;
+  }
+}
+
+// static
+void CrashDetect::WarmUpDebugInfo() {
+  os::SetCurrentThreadLowPriority();
+
+  std::unique_lock<std::mutex> lock(warmup_mutex_);
+  for (;;) {
+    while (!warmup_stop_ && warmup_queue_.empty()) {
+      warmup_cond_.wait(lock);
+    }
+    if (warmup_stop_) {
+      break;
+    }
+
+    warmup_current_ = warmup_queue_.front();
+    warmup_queue_.pop_front();
+
+    lock.unlock();
+    warmup_current_->LoadDebugInfo();
+    lock.lock();
+
+    warmup_current_ = nullptr;
+    warmup_cond_.notify_all();
+  }
+}
+
+template<unsigned int Features>
 int CrashDetect::OnDebugHook() {
-  if (amx_.GetFrm() < last_frame_
-      && (Options::shared().trace_flags() & TRACE_FUNCTIONS)
-      && debug_info_.IsLoaded()) {
-    AMXStackTrace trace = GetAMXStackTrace(
-      amx_,
-      amx_.GetFrm(),
-      amx_.GetCip(),
-      1);
-    if (trace.current_frame().return_address() != 0) {
-      PrintTraceFrame(trace.current_frame(), debug_info_);
-    }
-  }
-  last_frame_ = amx_.GetFrm();
+  if (Features & HOOK_TRACE_FUNCTIONS) {
+    if (amx_.GetFrm() < last_frame_ && debug_info().IsLoaded()) {
+      AMXRawFrame frame;
+      if (UnwindAMXStack(amx_, amx_.GetFrm(), amx_.GetCip(), &frame, 1) > 0) {
+        PrintTraceFrame(AMXStackFrame(amx_, frame),
+                        (Features & HOOK_TRACE_FILTER) != 0);
+      }
+    }
+    last_frame_ = amx_.GetFrm();
+  }
+  if ((Features & HOOK_PROFILE) && profile_functions_) {
+    ProfileFunctions();
+  }
+  if ((Features & HOOK_PROFILE) && profile_lines_) {
+    profiler_->CountStatement(amx_.GetCip(), Clock::now());
+  }
   return prev_debug_ != nullptr ? prev_debug_(amx_) : AMX_ERR_NONE;
 }
 
+template<unsigned int Features>
 int CrashDetect::OnCallback(cell index, cell *result, cell *params) {
-  Push(AMXCall::Native(amx_, index));
+  // Call sites are patched before calling the native, like amx_Callback()
+  // does: if the native re-enters amx_Exec() (e.g. CallLocalFunction), CIP
+  // no longer points at this call site when it returns.
+  if (!IsInstrumentedNative(index)) {
+    if (fast_natives_) {
+      PatchNativeCall(index, false);
+    }
+    return prev_callback_(amx_, index, result, params);
+  }
+
+  if (!(Features & (HOOK_TRACE_NATIVES | HOOK_PROFILE)) && fast_natives_) {
+    // Calls through the thunk aren't traced or profiled, so leave the call
+    // on this path while native tracing or the profiler is on.
+    PatchNativeCall(index, true);
+  }
 
-  if (Options::shared().trace_flags() & TRACE_NATIVES) {
+  Push<Features>(AMXCall::Native(amx_, index));
+
+  if (Features & HOOK_TRACE_NATIVES) {
     std::stringstream stream;
     const char *name = amx_.GetNativeName(index);
     stream << "native " << (name != nullptr ? name : "<unknown>") << " ()";
-    if (Options::shared().trace_filter() == nullptr
-        || Options::shared().trace_filter()->Test(stream.str())) {
+    const RegExp *filter = Options::shared().trace_filter();
+    if (!(Features & HOOK_TRACE_FILTER)
+        || filter == nullptr
+        || filter->Test(stream.str())) {
       PrintStream(LogTracePrint, stream);
     }
   }
 
+  Clock::time_point start_time;
+  if (Features & HOOK_PROFILE) {
+    start_time = Clock::now();
+    thread_state().profile_stack.Enter(profiler_->GetNativeCounters(index),
+                                       start_time);
+  }
+
   int error = prev_callback_(amx_, index, result, params);
 
-  Pop();
+  if (Features & HOOK_PROFILE) {
+    Clock::time_point end_time = Clock::now();
+    thread_state().profile_stack.Leave(end_time);
+    profiler_->RecordNativeTime(index, end_time - start_time);
+  }
+
+  Pop<Features>();
   return error;
 }
 
+template<unsigned int Features>
 int CrashDetect::OnExec(cell *retval, int index) {
-  Push(AMXCall::Public(amx_, index));
+  // Call sites can only be rewritten safely when no script is running on
+  // this thread. The same script can't be running on another thread at the
+  // same time either, as it has only one set of registers.
+  if (unpatch_natives_pending_.load(std::memory_order_acquire)
+      && thread_state().call_stack.IsEmpty()) {
+    UnpatchNativeCalls();
+  }
 
-  if (Options::shared().trace_flags() & TRACE_FUNCTIONS) {
+  Push<Features>(AMXCall::Public(amx_, index));
+
+  if (Features & HOOK_TRACE_FUNCTIONS) {
     last_frame_ = 0;
   }
-  if (Options::shared().trace_flags() & TRACE_PUBLICS) {
+  if ((Features & HOOK_TRACE_PUBLICS) && trace_buffer_size_ != 0) {
+    RecordPublicCall(index);
+  } else if (Features & HOOK_TRACE_PUBLICS) {
     if (cell address = amx_.GetPublicAddress(index)) {
-      AMXStackTrace trace = GetAMXStackTrace(
-        amx_,
-        amx_.GetFrm(),
-        amx_.GetCip(),
-        1);
-      AMXStackFrame frame = trace.current_frame();
-      if (frame.return_address() != 0) {
+      AMXRawFrame raw_frame;
+      if (UnwindAMXStack(amx_,
+                         amx_.GetFrm(),
+                         amx_.GetCip(),
+                         &raw_frame,
+                         1) > 0) {
+        AMXStackFrame frame(amx_, raw_frame);
         frame.set_caller_address(address);
-        PrintTraceFrame(frame, debug_info_);
+        PrintTraceFrame(frame, (Features & HOOK_TRACE_FILTER) != 0);
       } else {
         AMXStackFrame fake_frame(
           amx_,
@@ -185,12 +594,34 @@ int CrashDetect::OnExec(cell *retval, int index) {
           0,
           0,
           address);
-        PrintTraceFrame(fake_frame, debug_info_);
+        PrintTraceFrame(fake_frame,
+                        (Features & HOOK_TRACE_FILTER) != 0);
       }
     }
   }
 
+  if (Features & HOOK_PROFILE) {
+    thread_state().profile_stack.Enter(profiler_->GetPublicCounters(index),
+                                       Clock::now());
+  }
+
   int error = ::amx_Exec(amx_, retval, index);
+
+  if (Features & HOOK_PROFILE) {
+    ThreadState &state = thread_state();
+    Clock::time_point now = Clock::now();
+    state.profile_stack.Leave(now);
+    // Don't charge the time until the script runs again to its last
+    // statement.
+    profiler_->EndStatement(now);
+    if (state.profile_stack.IsEmpty() && now >= profiler_next_write_) {
+      WriteProfile();
+      PrintNativeLatencies();
+      profiler_next_write_ =
+        now + std::chrono::seconds(Options::shared().profiler_interval());
+    }
+  }
+
   if (error == AMX_ERR_CALLBACK
       || error == AMX_ERR_NOTFOUND
       || error == AMX_ERR_INIT
@@ -201,7 +632,21 @@ int CrashDetect::OnExec(cell *retval, int index) {
     OnExecError(index, retval, error);
   }
 
-  Pop();
+  Pop<Features>();
+
+  if (sampled_thread_state_ != nullptr) {
+    ThreadState &state = thread_state();
+    if (&state == sampled_thread_state_ && state.call_stack.IsEmpty()) {
+      ProcessSamples();
+      Clock::time_point now = Clock::now();
+      if (now >= samples_next_write_) {
+        WriteSamples();
+        samples_next_write_ =
+          now + std::chrono::seconds(Options::shared().profiler_interval());
+      }
+    }
+  }
+
   return error;
 }
 
@@ -252,7 +697,7 @@ int CrashDetect::OnExecError(int index, cell *retval, int error) {
       cell suppress_addr, *suppress_ptr;
       amx_PushArray(amx_, &suppress_addr, &suppress_ptr, &suppress, 1);
       amx_Push(amx_, error);
-      OnExec(retval, callback_index);
+      exec_hook()(amx(), retval, callback_index);
       amx_Release(amx_, suppress_addr);
       suppress = *suppress_ptr;
     }
@@ -304,9 +749,11 @@ int CrashDetect::OnAddressNaughtRequest(int option) {
 
 // static
 void CrashDetect::OnCrash(const os::Context &context) {
+  // Crashes are handled on the thread that crashed. Don't use
+  // thread_state() here as it may allocate.
   CrashDetect *instance = nullptr;
-  if (!call_stack_.IsEmpty()) {
-    instance = GetHandler(call_stack_.Top().amx());
+  if (thread_state_ != nullptr && !thread_state_->call_stack.IsEmpty()) {
+    instance = GetHandler(thread_state_->call_stack.Top().amx());
   }
   if (instance != nullptr) {
     LogDebugPrint("Server crashed while executing %s",\
@@ -314,18 +761,47 @@ void CrashDetect::OnCrash(const os::Context &context) {
   } else {
     LogDebugPrint("Server crashed due to an unknown error");
   }
-  PrintAMXBacktrace();
+  if (thread_state_ != nullptr) {
+    std::stringstream stream;
+    PrintAMXBacktrace(stream, thread_state_->call_stack, false);
+    PrintStream(LogDebugPrint, stream);
+  }
   PrintNativeBacktrace(context.native_context());
   PrintRegisters(context);
   PrintStack(context);
   PrintLoadedModules();
 }
 
+// static
+void CrashDetect::OnProfileTimer(const os::Context &context) {
+  // A signal may still be pending after the timer has been stopped.
+  const ThreadState *state = sampled_thread_state_;
+  if (state != nullptr) {
+    AMXSampler::shared().Capture(
+      state->call_stack,
+      debug_hook_needed_.load(std::memory_order_relaxed));
+  }
+}
+
 // static
 void CrashDetect::OnInterrupt(const os::Context &context) {
+  // The signal may be delivered to a thread that isn't running any script,
+  // in which case show the first thread that is. Its stack may change under
+  // our feet, but the server is most likely stuck in there anyway.
+  const ThreadState *state = thread_state_;
+  if (state == nullptr || state->call_stack.IsEmpty()) {
+    for (const ThreadState *s = thread_states_.load(); s != nullptr;
+         s = s->next) {
+      if (s->in_use && !s->call_stack.IsEmpty()) {
+        state = s;
+        break;
+      }
+    }
+  }
+
   CrashDetect *instance = nullptr;
-  if (!call_stack_.IsEmpty()) {
-    instance = GetHandler(call_stack_.Top().amx());
+  if (state != nullptr && !state->call_stack.IsEmpty()) {
+    instance = GetHandler(state->call_stack.Top().amx());
   }
   if (instance != nullptr) {
     LogDebugPrint("Server received interrupt signal while executing %s",
@@ -333,18 +809,20 @@ void CrashDetect::OnInterrupt(const os::Context &context) {
   } else {
     LogDebugPrint("Server received interrupt signal");
   }
-  PrintAMXBacktrace();
+  if (state != nullptr) {
+    std::stringstream stream;
+    PrintAMXBacktrace(stream, state->call_stack, false);
+    PrintStream(LogDebugPrint, stream);
+  }
   PrintNativeBacktrace(context.native_context());
 }
 
-// static
-void CrashDetect::PrintTraceFrame(const AMXStackFrame &frame,
-                                  const AMXDebugInfo &debug_info) {
+void CrashDetect::PrintTraceFrame(const AMXStackFrame &frame, bool filter) {
   std::stringstream stream;
-  AMXStackFramePrinter printer(stream, debug_info);
+  AMXStackFramePrinter printer(stream, debug_info(), location_cache());
   printer.PrintCallerNameAndArguments(frame);
-  if (Options::shared().trace_filter() == nullptr
-      || Options::shared().trace_filter()->Test(stream.str())) {
+  const RegExp *trace_filter = Options::shared().trace_filter();
+  if (!filter || trace_filter == nullptr || trace_filter->Test(stream.str())) {
     PrintStream(LogTracePrint, stream);
   }
 }
@@ -419,25 +897,34 @@ void CrashDetect::PrintAMXBacktrace() {
 
 // static
 void CrashDetect::PrintAMXBacktrace(std::ostream &stream) {
-  if (call_stack_.IsEmpty()) {
+  PrintAMXBacktrace(stream, thread_state().call_stack);
+}
+
+// static
+void CrashDetect::PrintAMXBacktrace(std::ostream &stream,
+                                    const AMXCallStack &calls,
+                                    bool load_debug_info) {
+  if (calls.IsEmpty()) {
     return;
   }
 
-  AMXRef amx = call_stack_.Top().amx();
+  AMXRef amx = calls.Top().amx();
   AMXRef top_amx = amx;
 
-  AMXCallStack calls = call_stack_;
+  // Walk the call stack in place (top to bottom) rather than popping calls
+  // off a copy, so that this doesn't allocate when called from a crash.
+  std::size_t index = calls.size();
 
   cell cip = top_amx.GetCip();
   cell frm = top_amx.GetFrm();
   int level = 0;
 
-  if (!calls.IsEmpty() && cip != 0) {
+  if (cip != 0) {
     stream << "AMX backtrace:";
   }
 
-  while (!calls.IsEmpty() && cip != 0 && amx == top_amx) {
-    AMXCall call = calls.Pop();
+  while (index > 0 && cip != 0 && amx == top_amx) {
+    const AMXCall &call = calls[--index];
 
     // native function
     if (call.IsNative()) {
@@ -456,32 +943,27 @@ void CrashDetect::PrintAMXBacktrace(std::ostream &stream) {
     else if (call.IsPublic()) {
       CrashDetect *handler = GetHandler(amx);
 
-      AMXStackTrace trace = GetAMXStackTrace(amx, frm, cip, 100);
-      std::deque<AMXStackFrame> frames;
-
-      while (trace.current_frame().return_address() != 0) {
-        frames.push_back(trace.current_frame());
-        if (!trace.MoveNext()) {
-          break;
-        }
-      }
+      AMXRawFrame raw_frames[kMaxBacktraceFrames];
+      int num_frames =
+        UnwindAMXStack(amx, frm, cip, raw_frames, kMaxBacktraceFrames);
 
       cell entry_point = amx.GetPublicAddress(call.index());
-      if (frames.empty()) {
-        AMXStackFrame fake_frame(amx, frm, 0, 0, entry_point);
-        frames.push_front(fake_frame);
-      } else {
-        frames.back().set_caller_address(entry_point);
-      }
+      for (int i = 0; i < std::max(num_frames, 1); i++) {
+        AMXStackFrame frame = num_frames > 0
+          ? AMXStackFrame(amx, raw_frames[i])
+          : AMXStackFrame(amx, frm, 0, 0, entry_point);
+        if (i == num_frames - 1) {
+          frame.set_caller_address(entry_point);
+        }
 
-      for (std::deque<AMXStackFrame>::const_iterator it = frames.begin();
-           it != frames.end(); it++) {
-        const AMXStackFrame &frame = *it;
+        const AMXDebugInfo &debug_info = load_debug_info
+          ? handler->debug_info()
+          : handler->loaded_debug_info();
 
         stream << "\n#" << level++ << " ";
-        frame.Print(stream, handler->debug_info_);
+        frame.Print(stream, debug_info, handler->location_cache());
 
-        if (!handler->debug_info_.IsLoaded()) {
+        if (!debug_info.IsLoaded()) {
           stream << " in " << handler->amx_name_;
         }
       }
@@ -550,24 +1032,340 @@ void CrashDetect::PrintLoadedModules() {
 }
 
 // static
+template<unsigned int Features>
 void CrashDetect::Push(AMXCall call) {
-  if (call_stack_.IsEmpty()) {
-    long_call_time_next_ =
-        std::chrono::high_resolution_clock::now() + long_call_time_current_;
+  ThreadState &state = thread_state();
+  if ((Features & HOOK_LONG_CALL) && state.call_stack.IsEmpty()) {
+    state.long_call_time_next =
+        Clock::now() + long_call_time_current_;
   }
-  call_stack_.Push(call);
+  state.call_stack.Push(call);
 }
 
 // static
+template<unsigned int Features>
 AMXCall CrashDetect::Pop() {
-  AMXCall call = call_stack_.Pop();
-  if (call_stack_.IsEmpty()) {
-    long_call_time_next_ =
-        std::chrono::high_resolution_clock::time_point::max();
+  ThreadState &state = thread_state();
+  AMXCall call = state.call_stack.Pop();
+  if ((Features & HOOK_LONG_CALL) && state.call_stack.IsEmpty()) {
+    state.long_call_time_next =
+        Clock::time_point::max();
+  }
+  if (state.call_stack.IsEmpty() && !state.public_calls.empty()) {
+    FlushPublicCalls(state, (Features & HOOK_TRACE_FILTER) != 0);
   }
   return call;
 }
 
+void CrashDetect::RecordPublicCall(cell index) {
+  ThreadState &state = thread_state();
+  if (state.public_calls.size() >= trace_buffer_size_) {
+    FlushPublicCalls(state, Options::shared().trace_filter() != nullptr);
+  }
+  if (state.public_calls.capacity() < trace_buffer_size_) {
+    state.public_calls.reserve(trace_buffer_size_);
+  }
+  PublicCallRecord record = {
+    amx(),
+    index,
+    Clock::now()
+  };
+  state.public_calls.push_back(record);
+}
+
+// static
+void CrashDetect::FlushPublicCalls(ThreadState &state, bool filter) {
+  const RegExp *trace_filter = Options::shared().trace_filter();
+  Clock::time_point start_time = state.public_calls.front().time;
+
+  for (std::vector<PublicCallRecord>::const_iterator it =
+         state.public_calls.begin();
+       it != state.public_calls.end(); it++) {
+    const PublicCallRecord &record = *it;
+    const char *name = AMXRef(record.amx).GetPublicName(record.index);
+    if (name == nullptr) {
+      continue;
+    }
+
+    std::stringstream stream;
+    stream << "public " << name << " ()";
+    if (filter
+        && trace_filter != nullptr
+        && !trace_filter->Test(stream.str())) {
+      continue;
+    }
+
+    std::chrono::microseconds offset =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        record.time - start_time);
+    stream << " +" << offset.count() << "us";
+    PrintStream(LogTracePrint, stream);
+  }
+
+  state.public_calls.clear();
+}
+
+void CrashDetect::ProfileFunctions() {
+  // The frame's return address tells a new call from the one that was
+  // running in the same frame before, and the callee address of the CALL
+  // before it is the function's address.
+  cell frm = amx_.GetFrm();
+  AMXStackFrame frame(amx_, frm);
+  AMXProfileStack &profile_stack = thread_state().profile_stack;
+  if (!profile_stack.IsCurrentFunction(frm, frame.return_address())) {
+    profile_stack.SwitchFunction(
+      frm,
+      frame.return_address(),
+      profiler_->GetFunctionCounters(frame.callee_address()),
+      Clock::now());
+  }
+}
+
+void CrashDetect::WriteProfile() {
+  if (amx_path_.empty()) {
+    return;
+  }
+
+  // gamemodes/foo.amx -> gamemodes/foo-profile.txt
+  std::string file_name = fileutils::GetFileName(amx_path_);
+  std::string path =
+    amx_path_.substr(0, amx_path_.length() - file_name.length())
+    + fileutils::GetBaseName(amx_path_) + "-profile.txt";
+
+  std::stringstream stream;
+  profiler_->WriteReport(stream, "Profile of " + amx_path_, debug_info());
+
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    LogDebugPrint("Could not write profile to %s", path.c_str());
+    return;
+  }
+  std::fputs(stream.str().c_str(), file);
+  std::fclose(file);
+}
+
+// static
+void CrashDetect::ProcessSamples() {
+  AMXSampler::Sample sample;
+  while (AMXSampler::shared().Read(sample)) {
+    // Folded stacks go from the outermost function to the innermost.
+    std::string stack;
+    for (int i = sample.num_frames - 1; i >= 0; i--) {
+      if (!stack.empty()) {
+        stack += ';';
+      }
+      stack += GetSampleFrameName(sample.frames[i]);
+    }
+    if (!stack.empty()) {
+      sampled_stacks_[stack]++;
+    }
+  }
+}
+
+// static
+void CrashDetect::WriteSamples() {
+  const std::string &path = Options::shared().sampling_profiler_output();
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    LogDebugPrint("Could not write samples to %s", path.c_str());
+    return;
+  }
+  for (std::map<std::string, unsigned long>::const_iterator it =
+         sampled_stacks_.begin();
+       it != sampled_stacks_.end(); it++) {
+    std::fprintf(file, "%s %lu\n", it->first.c_str(), it->second);
+  }
+  std::fclose(file);
+}
+
+// static
+std::string CrashDetect::GetSampleFrameName(const AMXSampler::Frame &frame) {
+  AMXRef amx = frame.amx;
+  const char *name = nullptr;
+  switch (frame.type) {
+    case AMXSampler::Frame::NATIVE:
+      name = amx.GetNativeName(frame.index);
+      break;
+    case AMXSampler::Frame::PUBLIC:
+      if (frame.index == AMX_EXEC_MAIN) {
+        return "main";
+      }
+      name = amx.GetPublicName(frame.index);
+      break;
+    case AMXSampler::Frame::FUNCTION: {
+      CrashDetect *handler = GetHandler(amx);
+      if (handler != nullptr) {
+        std::string function_name =
+          handler->debug_info().GetFunctionName(frame.address);
+        if (!function_name.empty()) {
+          return function_name;
+        }
+      }
+      break;
+    }
+  }
+  return name != nullptr ? name : "??";
+}
+
+void CrashDetect::PrintNativeLatencies() {
+  if (!Options::shared().profiler_histograms()) {
+    return;
+  }
+  std::stringstream stream;
+  profiler_->WriteNativeLatencies(stream);
+  if (stream.tellp() > 0) {
+    LogDebugPrint("Native function latencies in %s:", amx_name_.c_str());
+    PrintStream(LogDebugPrint, stream);
+  }
+}
+
+bool CrashDetect::IsInstrumentedNative(cell index) const {
+  if (instrumented_natives_.empty()) {
+    return true;
+  }
+  return index >= 0
+    && static_cast<std::size_t>(index) < instrumented_natives_.size()
+    && instrumented_natives_[index];
+}
+
+void CrashDetect::PatchNativeCall(cell index, bool instrumented) {
+  if (instrumented && out_of_thunks_) {
+    return;
+  }
+
+  // This is the same check as in amx_Callback(): CIP points right past the
+  // operand of SYSREQ.C (but not SYSREQ.PRI, which has no operand).
+  cell cip = amx_.GetCip();
+  if (cip < static_cast<cell>(2 * sizeof(cell))) {
+    return;
+  }
+  cell *code = reinterpret_cast<cell*>(amx_.GetCode() + cip) - 1;
+#if (defined __GNUC__ && !defined __MINGW32__) || defined ASM32
+  if (code[0] != index) {
+    return;
+  }
+#else
+  if (code[0] != index || code[-1] != AMX_OP_SYSREQ_C) {
+    return;
+  }
+#endif
+
+  // Natives that don't need instrumentation are called directly, others go
+  // through a thunk that keeps track of them in the call stack.
+  AMX_NATIVE native =
+    reinterpret_cast<AMX_NATIVE>(amx_.GetNativeAddress(index));
+  if (native == nullptr) {
+    return;
+  }
+  if (instrumented) {
+    native = AMXNativeThunks::shared().Get(amx(), index, native);
+    if (native == nullptr) {
+      // The remaining call sites stay on the slow path.
+      out_of_thunks_ = true;
+      return;
+    }
+
+    // Remember the original instruction so that the call can be put back
+    // on the slow path if tracing or profiling is turned on later.
+    NativePatch patch;
+    patch.cip = cip;
+    patch.opcode = code[-1];
+    patch.index = index;
+    native_patches_.push_back(patch);
+  }
+
+  // The two cells are written separately, which is fine because this runs
+  // on the thread that is executing the script, right after the call.
+  code[-1] = sysreq_d_;
+  code[0] = reinterpret_cast<cell>(native);
+}
+
+void CrashDetect::UnpatchNativeCalls() {
+  unpatch_natives_pending_.store(false, std::memory_order_relaxed);
+  for (std::vector<NativePatch>::const_iterator it = native_patches_.begin();
+       it != native_patches_.end(); ++it) {
+    cell *code = reinterpret_cast<cell*>(amx_.GetCode() + it->cip) - 1;
+    code[-1] = it->opcode;
+    code[0] = it->index;
+  }
+  native_patches_.clear();
+}
+
+// static
+cell CrashDetect::CallNative(AMX *amx,
+                             cell index,
+                             AMX_NATIVE native,
+                             cell *params) {
+  // Natives are always called from inside of a public function, so there's
+  // no long call bookkeeping to do here (see Push()).
+  AMXCallStack &call_stack = thread_state().call_stack;
+  call_stack.Push(AMXCall::Native(amx, index));
+  cell result = native(amx, params);
+  call_stack.Pop();
+  return result;
+}
+
+CrashDetect::ThreadState::ThreadState()
+  : long_call_time_next(Clock::time_point::max()),
+    in_use(true),
+    next(nullptr)
+{
+}
+
+// Releases the current thread's state when the thread exits.
+class CrashDetect::ThreadStateHolder {
+ public:
+  ThreadStateHolder() {
+    thread_state_ = AcquireThreadState();
+  }
+  ~ThreadStateHolder() {
+    ReleaseThreadState(thread_state_);
+    thread_state_ = nullptr;
+  }
+};
+
+// static
+CrashDetect::ThreadState &CrashDetect::thread_state() {
+  if (thread_state_ == nullptr) {
+    static thread_local ThreadStateHolder holder;
+  }
+  return *thread_state_;
+}
+
+// static
+CrashDetect::ThreadState *CrashDetect::AcquireThreadState() {
+  for (ThreadState *state = thread_states_.load(std::memory_order_acquire);
+       state != nullptr; state = state->next) {
+    bool in_use = false;
+    if (state->in_use.compare_exchange_strong(in_use, true,
+                                              std::memory_order_acquire)) {
+      return state;
+    }
+  }
+  // States are never freed (and never removed from the list), which is what
+  // makes it safe to walk the list without locking.
+  ThreadState *state = new ThreadState;
+  state->next = thread_states_.load(std::memory_order_relaxed);
+  while (!thread_states_.compare_exchange_weak(state->next, state,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+  }
+  return state;
+}
+
+// static
+void CrashDetect::ReleaseThreadState(ThreadState *state) {
+  // Whatever is left here may refer to scripts that are gone by the time
+  // the state is picked up by another thread.
+  while (!state->call_stack.IsEmpty()) {
+    state->call_stack.Pop();
+  }
+  state->public_calls.clear();
+  state->profile_stack.Clear();
+  state->long_call_time_next = Clock::time_point::max();
+  state->in_use.store(false, std::memory_order_release);
+}
+
 void CrashDetect::PrintNativeBacktrace(const os::Context &context) {
   std::stringstream stream;
   PrintNativeBacktrace(stream, context);
@@ -614,14 +1412,16 @@ unsigned int CrashDetect::LongCallOption(int option) {
     case AMX_LCT_OPTION_ACTIVE:
       return long_call_time_running_;
     case AMX_LCT_OPTION_RESTART:
-      long_call_time_next_ =
-          std::chrono::high_resolution_clock::now() + long_call_time_current_;
+      thread_state().long_call_time_next =
+          Clock::now() + long_call_time_current_;
       break;
     case AMX_LCT_OPTION_DISABLE:
       long_call_time_running_ = false;
+      UpdateHooks();
       break;
     case AMX_LCT_OPTION_ENABLE:
       long_call_time_running_ = long_call_time_ != 0;
+      UpdateHooks();
       break;
     case AMX_LCT_OPTION_RESET:
       SetLongCallTime(long_call_time_);
@@ -635,10 +1435,11 @@ void CrashDetect::CheckLongCallTime(void) {
   if (!long_call_time_running_) {
     return;
   }
-  if (long_call_time_next_ < std::chrono::high_resolution_clock::now()) {
+  ThreadState &state = thread_state();
+  if (state.long_call_time_next < Clock::now()) {
     // Disable repeat stack dumps by setting this WAY in the future.
-    long_call_time_next_ =
-        std::chrono::high_resolution_clock::time_point::max();
+    state.long_call_time_next =
+        Clock::time_point::max();
     LogDebugPrint("Long callback execution detected (hang or performance issue)");
     PrintAMXBacktrace();
   }
@@ -25,14 +25,26 @@
 #ifndef CRASHDETECT_H
 #define CRASHDETECT_H
 
+#include <atomic>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdio>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include "amxcallstack.h"
 #include "amxdebuginfo.h"
 #include "amxhandler.h"
+#include "amxlocationcache.h"
+#include "amxprofiler.h"
 #include "amxref.h"
+#include "amxsampler.h"
+#include "clock.h"
+#include "options.h"
 #include "regexp.h"
 
 class AMXStackFrame;
@@ -48,19 +60,52 @@ class CrashDetect: public AMXHandler<CrashDetect> {
   int Load();
   int Unload();
 
+  template<unsigned int Features>
   int OnDebugHook();
+  template<unsigned int Features>
   int OnCallback(cell index, cell *result, cell *params);
+  template<unsigned int Features>
   int OnExec(cell *retval, int index);
   int OnExecError(int index, cell *retval, int error);
   int OnLongCallRequest(int option, int value);
   int OnAddressNaughtRequest(int option);
 
+  AMXLocationCache *location_cache();
+  const AMXProfiler *profiler() const { return profiler_.get(); }
+
  public:
+  // The hooks are compiled for every combination of these features and the
+  // variant that matches current options is installed, so that there is no
+  // tracing code at all in them when tracing is off.
+  enum HookFeatures {
+    HOOK_TRACE_NATIVES = TRACE_NATIVES,
+    HOOK_TRACE_PUBLICS = TRACE_PUBLICS,
+    HOOK_TRACE_FUNCTIONS = TRACE_FUNCTIONS,
+    HOOK_TRACE_FILTER = 0x08,
+    HOOK_LONG_CALL = 0x10,
+    HOOK_PROFILE = 0x20,
+    HOOK_ALL = 0x3F
+  };
+
+  typedef int (AMXAPI *AMX_EXEC)(AMX *amx, cell *retval, int index);
+
+  // The debug hook is only installed while something needs it (function
+  // tracing or the long call check); otherwise this returns whatever hook
+  // the script had before.
+  AMX_DEBUG debug_hook() const;
+  static AMX_CALLBACK callback();
+  static AMX_EXEC exec_hook();
+
+  // Switches to the hooks matching current options, e.g. after tracing has
+  // been turned on or off.
+  static void UpdateHooks();
+
   static void PluginLoad();
   static void PluginUnload();
 
   static void OnCrash(const os::Context &context);
   static void OnInterrupt(const os::Context &context);
+  static void OnProfileTimer(const os::Context &context);
 
   static void PrintAMXBacktrace();
   static void PrintAMXBacktrace(std::ostream &stream);
@@ -70,15 +115,89 @@ class CrashDetect: public AMXHandler<CrashDetect> {
                                    const os::Context &context);
 
  private:
-  static void PrintTraceFrame(const AMXStackFrame &frame,
-                              const AMXDebugInfo &debug_info);
+  // A public call recorded by `trace p` when trace_buffer_size is set. These
+  // are formatted and printed in one go once the outermost call returns.
+  struct PublicCallRecord {
+    AMX *amx;
+    cell index;
+    Clock::time_point time;
+  };
+
+  // A call site patched by PatchNativeCall() to call a native thunk, along
+  // with what was there originally.
+  struct NativePatch {
+    cell cip;
+    cell opcode;
+    cell index;
+  };
+
+  // Per-thread call stack and long call deadline. Each thread that runs
+  // scripts gets its own, so that plugins calling amx_Exec() from worker
+  // threads don't mess up each other's stacks. States are kept in a
+  // lock-free list (for the crash and interrupt handlers) and are reused
+  // by new threads after their previous owner exits.
+  struct ThreadState {
+    ThreadState();
+
+    AMXCallStack call_stack;
+    std::vector<PublicCallRecord> public_calls;
+    AMXProfileStack profile_stack;
+    Clock::time_point long_call_time_next;
+    std::atomic<bool> in_use;
+    ThreadState *next;
+  };
+
+  class ThreadStateHolder;
+
+  static ThreadState &thread_state();
+  static ThreadState *AcquireThreadState();
+  static void ReleaseThreadState(ThreadState *state);
+
+  // Signal handlers must pass false for load_debug_info: debug info that is
+  // not loaded yet is skipped instead of loaded then and there.
+  static void PrintAMXBacktrace(std::ostream &stream,
+                                const AMXCallStack &calls,
+                                bool load_debug_info = true);
+
+  void RecordPublicCall(cell index);
+  static void FlushPublicCalls(ThreadState &state, bool filter);
+
+  void ProfileFunctions();
+  void WriteProfile();
+  void PrintNativeLatencies();
+
+  static void ProcessSamples();
+  static void WriteSamples();
+  static std::string GetSampleFrameName(const AMXSampler::Frame &frame);
+
+ private:
+  const AMXDebugInfo &debug_info();
+  const AMXDebugInfo &loaded_debug_info() const;
+  void LoadDebugInfo();
+
+  static void WarmUpDebugInfo();
+
+  void PrintTraceFrame(const AMXStackFrame &frame, bool filter);
   static void PrintRuntimeError(AMXRef amx, const AMX &amx_state, int error);
   static void PrintRegisters(const os::Context &context);
   static void PrintStack(const os::Context &context);
   static void PrintLoadedModules();
+  template<unsigned int Features>
   static void Push(AMXCall call);
+  template<unsigned int Features>
   static AMXCall Pop();
 
+  static unsigned int GetHookFeatures();
+  static bool IsDebugHookNeeded(unsigned int features);
+
+  bool IsInstrumentedNative(cell index) const;
+  void PatchNativeCall(cell index, bool instrumented);
+  void UnpatchNativeCalls();
+  static cell CallNative(AMX *amx,
+                         cell index,
+                         AMX_NATIVE native,
+                         cell *params);
+
   static void SetLongCallTime(unsigned int time);
   static unsigned int LongCallOption(int option);
   static void CheckLongCallTime(void);
@@ -88,21 +207,47 @@ class CrashDetect: public AMXHandler<CrashDetect> {
 
  private:
   AMXRef amx_;
-  AMXDebugInfo debug_info_;
+  std::shared_ptr<const AMXDebugInfo> debug_info_;
+  std::atomic<bool> debug_info_pending_;
+  std::mutex debug_info_mutex_;
+  AMXLocationCache location_cache_;
   AMX_DEBUG prev_debug_;
   AMX_CALLBACK prev_callback_;
   cell last_frame_;
   std::string amx_path_;
+  std::string debug_info_path_;
   std::string amx_name_;
   bool block_exec_errors_;
   bool address_naught_;
+  cell sysreq_d_;
+  bool fast_natives_;
+  bool out_of_thunks_;
+  std::vector<NativePatch> native_patches_;
+  std::atomic<bool> unpatch_natives_pending_;
+  std::vector<bool> instrumented_natives_;
+  std::unique_ptr<AMXProfiler> profiler_;
+  Clock::time_point profiler_next_write_;
 
  private:
-  static AMXCallStack call_stack_;
+  static std::atomic<unsigned int> hook_features_;
+  static std::atomic<bool> debug_hook_needed_;
+  static std::atomic<ThreadState*> thread_states_;
+  static thread_local ThreadState *thread_state_;
   static unsigned int long_call_time_;
+  static unsigned int trace_buffer_size_;
+  static bool profile_functions_;
+  static bool profile_lines_;
+  static ThreadState *sampled_thread_state_;
+  static std::map<std::string, unsigned long> sampled_stacks_;
+  static Clock::time_point samples_next_write_;
   static std::chrono::microseconds long_call_time_current_;
-  static std::chrono::high_resolution_clock::time_point long_call_time_next_;
   static bool long_call_time_running_;
+  static std::thread warmup_thread_;
+  static std::mutex warmup_mutex_;
+  static std::condition_variable warmup_cond_;
+  static std::deque<CrashDetect*> warmup_queue_;
+  static CrashDetect *warmup_current_;
+  static bool warmup_stop_;
 };
 
 #endif // !CRASHDETECT_H
@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <fnmatch.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "fileutils.h"
 
@@ -55,6 +56,15 @@ void GetDirectoryFiles(const std::string &directory, const std::string &pattern,
   }
 }
 
+long long GetModificationTimeNs(const std::string &path) {
+  struct stat attrib;
+  if (stat(path.c_str(), &attrib) == 0) {
+    return static_cast<long long>(attrib.st_mtim.tv_sec) * 1000000000LL
+         + attrib.st_mtim.tv_nsec;
+  }
+  return 0;
+}
+
 std::string GetCurrentWorkingtDirectory() {
   std::vector<char> buffer(256);
   while (getcwd(&buffer[0], buffer.size()) == 0 &&
@@ -62,6 +62,18 @@ void GetDirectoryFiles(const std::string &directory, const std::string &pattern,
   FindClose(hFindFile);
 }
 
+long long GetModificationTimeNs(const std::string &path) {
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+    return 0;
+  }
+  // FILETIME counts 100-nanosecond intervals.
+  ULARGE_INTEGER time;
+  time.LowPart = data.ftLastWriteTime.dwLowDateTime;
+  time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+  return static_cast<long long>(time.QuadPart) * 100;
+}
+
 std::string GetCurrentWorkingtDirectory() {
   DWORD size = GetCurrentDirectoryA(0, nullptr);
   std::vector<char> buffer(size);
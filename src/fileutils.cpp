@@ -73,6 +73,14 @@ std::time_t GetModificationTime(const std::string &path) {
   return 0;
 }
 
+long long GetFileSize(const std::string &path) {
+  struct stat attrib;
+  if (stat(path.c_str(), &attrib) == 0) {
+    return attrib.st_size;
+  }
+  return -1;
+}
+
 std::string GetRelativePath(std::string path) {
   return GetRelativePath(path, GetCurrentWorkingtDirectory());
 }
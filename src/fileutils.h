@@ -44,6 +44,12 @@ const char *GetFileExtensionPtr(const char *path);
 
 std::time_t GetModificationTime(const std::string &path);
 
+// Same as GetModificationTime() but in nanoseconds, so that it tells apart
+// changes made within the same second (as far as the file system can).
+// Returns 0 on error.
+long long GetModificationTimeNs(const std::string &path);
+long long GetFileSize(const std::string &path);
+
 void GetDirectoryFiles(const std::string &directory,
                        const std::string &pattern,
                        std::vector<std::string> &files);
@@ -0,0 +1,110 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "latencyhistogram.h"
+
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
+
+namespace {
+
+// Returns the index of the most significant bit set in a non-zero value.
+int FindLastSet(uint64_t value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32))) {
+    return static_cast<int>(index) + 32;
+  }
+  _BitScanReverse(&index, static_cast<unsigned long>(value));
+  return static_cast<int>(index);
+#else
+  return 63 - __builtin_clzll(value);
+#endif
+}
+
+} // anonymous namespace
+
+LatencyHistogram::LatencyHistogram()
+ : count_(0),
+   max_(0)
+{
+  std::memset(buckets_, 0, sizeof(buckets_));
+}
+
+void LatencyHistogram::Record(Clock::duration time) {
+  uint64_t value = time.count() > 0 ? static_cast<uint64_t>(time.count()) : 0;
+  buckets_[GetBucketIndex(value)]++;
+  count_++;
+  max_ = std::max(max_, value);
+}
+
+Clock::duration LatencyHistogram::GetValueAtPercentile(
+    double percentile) const {
+  if (count_ == 0) {
+    return Clock::duration(0);
+  }
+  uint64_t rank = static_cast<uint64_t>(
+    std::ceil(std::min(percentile, 100.0) / 100.0 * count_));
+  rank = std::max<uint64_t>(rank, 1);
+
+  uint64_t total = 0;
+  for (int i = 0; i < kBucketCount; i++) {
+    total += buckets_[i];
+    if (total >= rank && i < kBucketCount - 1) {
+      return Clock::duration(std::min(GetBucketMaxValue(i), max_));
+    }
+  }
+  // The last bucket has no upper bound.
+  return Clock::duration(max_);
+}
+
+// static
+int LatencyHistogram::GetBucketIndex(uint64_t value) {
+  // Values below kSubBucketCount have a bucket each, above that every power
+  // of two gets kSubBucketCount buckets of its own.
+  if (value < static_cast<uint64_t>(kSubBucketCount)) {
+    return static_cast<int>(value);
+  }
+  if (value >> kMaxValueBits != 0) {
+    return kBucketCount - 1;
+  }
+  int exponent = FindLastSet(value);
+  int shift = exponent - kSubBucketBits;
+  return (shift + 1) * kSubBucketCount
+    + static_cast<int>(value >> shift) - kSubBucketCount;
+}
+
+// static
+uint64_t LatencyHistogram::GetBucketMaxValue(int index) {
+  if (index < kSubBucketCount) {
+    return static_cast<uint64_t>(index);
+  }
+  int shift = index / kSubBucketCount - 1;
+  uint64_t sub_bucket = index % kSubBucketCount + kSubBucketCount;
+  return ((sub_bucket + 1) << shift) - 1;
+}
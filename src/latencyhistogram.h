@@ -0,0 +1,65 @@
+// Copyright (c) 2014-2021 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <stdint.h>
+#include "clock.h"
+
+// A log-linear histogram of durations, in the spirit of HdrHistogram: each
+// power of two range of nanoseconds is split into 32 equal buckets, so any
+// recorded value is known to within about 3%. Values of 2^36 ns (about 68
+// seconds) and above share the last bucket. The buckets are a fixed array,
+// so recording a value is just a few arithmetic operations.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Record(Clock::duration time);
+
+  uint64_t count() const { return count_; }
+  Clock::duration max() const { return Clock::duration(max_); }
+
+  // Returns the highest value that is equivalent (falls into the same
+  // bucket) to the value at the given percentile, e.g. 99.9.
+  Clock::duration GetValueAtPercentile(double percentile) const;
+
+ private:
+  static const int kSubBucketBits = 5;
+  static const int kSubBucketCount = 1 << kSubBucketBits;
+  static const int kMaxValueBits = 36;
+  static const int kBucketCount =
+    (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+
+  static int GetBucketIndex(uint64_t value);
+  static uint64_t GetBucketMaxValue(int index);
+
+ private:
+  uint32_t buckets_[kBucketCount];
+  uint64_t count_;
+  uint64_t max_;
+};
+
+#endif // !LATENCYHISTOGRAM_H
@@ -22,13 +22,33 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <chrono>
 #include <sstream>
+#include <string>
+#include <vector>
 #include "crashdetect.h"
 #include "natives.h"
+#include "options.h"
 #include "os.h"
 
 namespace {
 
+bool GetStringParam(AMX *amx, cell param, std::string &string) {
+  cell *string_ptr;
+  int length;
+  if (amx_GetAddr(amx, param, &string_ptr) != AMX_ERR_NONE
+      || amx_StrLen(string_ptr, &length) != AMX_ERR_NONE) {
+    return false;
+  }
+  std::vector<char> buffer(length + 1);
+  if (amx_GetString(&buffer[0], string_ptr, 0, buffer.size())
+      != AMX_ERR_NONE) {
+    return false;
+  }
+  string.assign(&buffer[0], length);
+  return true;
+}
+
 // native PrintAmxBacktrace();
 cell AMX_NATIVE_CALL PrintBacktrace(AMX *amx, cell *params) {
   CrashDetect::PrintAMXBacktrace();
@@ -73,11 +93,93 @@ cell AMX_NATIVE_CALL GetNativeBacktrace(AMX *amx, cell *params) {
   return 0;
 }
 
+// native GetLocationCacheStats(&hits, &misses);
+cell AMX_NATIVE_CALL GetLocationCacheStats(AMX *amx, cell *params) {
+  cell *hits_ptr;
+  cell *misses_ptr;
+  if (amx_GetAddr(amx, params[1], &hits_ptr) != AMX_ERR_NONE
+      || amx_GetAddr(amx, params[2], &misses_ptr) != AMX_ERR_NONE) {
+    return 0;
+  }
+
+  *hits_ptr = 0;
+  *misses_ptr = 0;
+
+  CrashDetect *handler = CrashDetect::GetHandler(amx);
+  if (handler == nullptr || handler->location_cache() == nullptr) {
+    return 0;
+  }
+
+  AMXLocationCache *cache = handler->location_cache();
+  *hits_ptr = static_cast<cell>(cache->hits());
+  *misses_ptr = static_cast<cell>(cache->misses());
+  return static_cast<cell>(cache->size());
+}
+
+// native GetNativeLatency(const name[], &p50, &p99, &p999, &maximum);
+cell AMX_NATIVE_CALL GetNativeLatency(AMX *amx, cell *params) {
+  std::string name;
+  if (!GetStringParam(amx, params[1], name)) {
+    return 0;
+  }
+
+  cell *values[4];
+  for (int i = 0; i < 4; i++) {
+    if (amx_GetAddr(amx, params[2 + i], &values[i]) != AMX_ERR_NONE) {
+      return 0;
+    }
+    *values[i] = 0;
+  }
+
+  CrashDetect *handler = CrashDetect::GetHandler(amx);
+  int index;
+  if (handler == nullptr
+      || handler->profiler() == nullptr
+      || amx_FindNative(amx, name.c_str(), &index) != AMX_ERR_NONE) {
+    return 0;
+  }
+  const LatencyHistogram *histogram =
+    handler->profiler()->GetNativeHistogram(index);
+  if (histogram == nullptr) {
+    return 0;
+  }
+
+  Clock::duration times[4] = {
+    histogram->GetValueAtPercentile(50.0),
+    histogram->GetValueAtPercentile(99.0),
+    histogram->GetValueAtPercentile(99.9),
+    histogram->max()
+  };
+  for (int i = 0; i < 4; i++) {
+    *values[i] = static_cast<cell>(
+      std::chrono::duration_cast<std::chrono::microseconds>(times[i])
+        .count());
+  }
+  return static_cast<cell>(histogram->count());
+}
+
+// native SetCrashDetectTrace(const flags[], const filter[] = "");
+cell AMX_NATIVE_CALL SetCrashDetectTrace(AMX *amx, cell *params) {
+  std::string flags;
+  std::string filter;
+  if (!GetStringParam(amx, params[1], flags)
+      || !GetStringParam(amx, params[2], filter)) {
+    return 0;
+  }
+  Options::shared().SetTraceFlags(flags);
+  Options::shared().SetTraceFilter(filter);
+  CrashDetect::UpdateHooks();
+  return 1;
+}
+
 const AMX_NATIVE_INFO natives[] = {
   {"PrintBacktrace",       PrintBacktrace},
   {"PrintNativeBacktrace", PrintNativeBacktrace},
   {"GetBacktrace",         GetBacktrace},
   {"GetNativeBacktrace",   GetNativeBacktrace},
+  {"GetLocationCacheStats", GetLocationCacheStats},
+  {"SetCrashDetectTrace",  SetCrashDetectTrace},
+  {"GetNativeLatency",     GetNativeLatency},
   // Backwards compatibility:
   {"PrintAmxBacktrace",    PrintBacktrace},
   {"GetAmxBacktrace",      GetBacktrace}
@@ -47,7 +47,8 @@ unsigned int TraceFlagsFromString(const std::string &s) {
 
 Options::Options():
   trace_flags_(0),
-  trace_filter_(nullptr)
+  trace_filter_(nullptr),
+  trace_natives_(nullptr)
 {
   ConfigReader server_cfg("server.cfg");
 
@@ -55,7 +56,13 @@ Options::Options():
   std::string trace_filter_pattern =
     server_cfg.GetValueWithDefault("trace_filter");
   if (!trace_filter_pattern.empty()) {
-    trace_filter_ = new RegExp(trace_filter_pattern);
+    trace_filter_.store(new RegExp(trace_filter_pattern),
+                        std::memory_order_release);
+  }
+  std::string trace_natives_pattern =
+    server_cfg.GetValueWithDefault("trace_natives");
+  if (!trace_natives_pattern.empty()) {
+    trace_natives_ = new RegExp(trace_natives_pattern);
   }
 
   log_path_ = server_cfg.GetValueWithDefault("crashdetect_log");
@@ -63,10 +70,66 @@ Options::Options():
     server_cfg.GetValueWithDefault("logtimeformat", "[%H:%M:%S]");
 
   long_call_time_ = server_cfg.GetValueWithDefault("long_call_time", 5000U);
+
+  lazy_debug_info_ =
+    server_cfg.GetValueWithDefault("lazy_debug_info", false);
+  debug_info_warmup_ =
+    server_cfg.GetValueWithDefault("debug_info_warmup", false);
+  debug_info_index_ =
+    server_cfg.GetValueWithDefault("debug_info_index", false);
+
+  location_cache_size_ =
+    server_cfg.GetValueWithDefault("location_cache_size", 256U);
+
+  symbol_paths_ =
+    server_cfg.GetValues<std::string>("crashdetect_symbols");
+
+  clock_type_ =
+    server_cfg.GetValueWithDefault("crashdetect_clock", "precise");
+
+  fast_natives_ = server_cfg.GetValueWithDefault("fast_natives", false);
+
+  trace_buffer_size_ =
+    server_cfg.GetValueWithDefault("trace_buffer_size", 0U);
+
+  profiler_ = server_cfg.GetValueWithDefault("profiler", false);
+  profiler_functions_ =
+    server_cfg.GetValueWithDefault("profiler_functions", false);
+  profiler_lines_ = server_cfg.GetValueWithDefault("profiler_lines", 0U);
+  profiler_histograms_ =
+    server_cfg.GetValueWithDefault("profiler_histograms", false);
+  profiler_interval_ =
+    server_cfg.GetValueWithDefault("profiler_interval", 60U);
+  sampling_profiler_ =
+    server_cfg.GetValueWithDefault("sampling_profiler", 0U);
+  sampling_profiler_output_ =
+    server_cfg.GetValueWithDefault("sampling_profiler_output",
+                                   "samples.folded");
 }
 
 Options::~Options() {
-  delete trace_filter_;
+  delete trace_filter_.load();
+  delete trace_natives_;
+  for (std::size_t i = 0; i < old_trace_filters_.size(); i++) {
+    delete old_trace_filters_[i];
+  }
+}
+
+void Options::SetTraceFlags(const std::string &flags) {
+  trace_flags_.store(TraceFlagsFromString(flags), std::memory_order_release);
+}
+
+void Options::SetTraceFilter(const std::string &pattern) {
+  RegExp *trace_filter = pattern.empty() ? nullptr : new RegExp(pattern);
+
+  // Scripts running on other threads may still be using the old filter,
+  // so keep it around until unload.
+  std::lock_guard<std::mutex> lock(trace_filter_mutex_);
+  RegExp *old_trace_filter =
+    trace_filter_.exchange(trace_filter, std::memory_order_acq_rel);
+  if (old_trace_filter != nullptr) {
+    old_trace_filters_.push_back(old_trace_filter);
+  }
 }
 
 // static
@@ -25,7 +25,10 @@
 #ifndef OPTIONS_H
 #define OPTIONS_H
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <vector>
 
 class RegExp;
 
@@ -39,15 +42,52 @@ enum TraceFlags {
 class Options {
  public:
   unsigned int trace_flags()
-    const { return trace_flags_; }
+    const { return trace_flags_.load(std::memory_order_acquire); }
   unsigned int long_call_time()
     const { return long_call_time_; }
   const RegExp *trace_filter()
-    const { return trace_filter_; }
+    const { return trace_filter_.load(std::memory_order_acquire); }
+  const RegExp *trace_natives()
+    const { return trace_natives_; }
   const std::string &log_path()
     const { return log_path_; }
   const std::string &log_time_format()
     const { return log_time_format_; }
+  bool lazy_debug_info()
+    const { return lazy_debug_info_; }
+  bool debug_info_warmup()
+    const { return debug_info_warmup_; }
+  bool debug_info_index()
+    const { return debug_info_index_; }
+  unsigned int location_cache_size()
+    const { return location_cache_size_; }
+  const std::vector<std::string> &symbol_paths()
+    const { return symbol_paths_; }
+  const std::string &clock_type()
+    const { return clock_type_; }
+  bool fast_natives()
+    const { return fast_natives_; }
+  unsigned int trace_buffer_size()
+    const { return trace_buffer_size_; }
+  bool profiler()
+    const { return profiler_; }
+  bool profiler_functions()
+    const { return profiler_functions_; }
+  unsigned int profiler_lines()
+    const { return profiler_lines_; }
+  bool profiler_histograms()
+    const { return profiler_histograms_; }
+  unsigned int profiler_interval()
+    const { return profiler_interval_; }
+  unsigned int sampling_profiler()
+    const { return sampling_profiler_; }
+  const std::string &sampling_profiler_output()
+    const { return sampling_profiler_output_; }
+
+  // These can be changed at run time with SetCrashDetectTrace(), by a script
+  // on any thread, while hooks on other threads read them.
+  void SetTraceFlags(const std::string &flags);
+  void SetTraceFilter(const std::string &pattern);
 
   static Options &shared();
 
@@ -58,11 +98,29 @@ class Options {
   ~Options();
 
  private:
-  unsigned int trace_flags_;
+  std::atomic<unsigned int> trace_flags_;
   unsigned int long_call_time_;
-  RegExp *trace_filter_;
+  std::atomic<RegExp*> trace_filter_;
+  std::vector<RegExp*> old_trace_filters_;
+  std::mutex trace_filter_mutex_;
+  RegExp *trace_natives_;
   std::string log_path_;
   std::string log_time_format_;
+  bool lazy_debug_info_;
+  bool debug_info_warmup_;
+  bool debug_info_index_;
+  unsigned int location_cache_size_;
+  std::vector<std::string> symbol_paths_;
+  std::string clock_type_;
+  bool fast_natives_;
+  unsigned int trace_buffer_size_;
+  bool profiler_;
+  bool profiler_functions_;
+  unsigned int profiler_lines_;
+  bool profiler_histograms_;
+  unsigned int profiler_interval_;
+  unsigned int sampling_profiler_;
+  std::string sampling_profiler_output_;
 };
 
 #endif // !OPTIONS_H
@@ -27,10 +27,19 @@
 #include <vector>
 #include <dlfcn.h>
 #include <link.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include <ucontext.h>
+#include <unistd.h>
 #include "os.h"
 
+#ifndef sigev_notify_thread_id
+  #define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 extern const char *__progname;
 
 namespace os {
@@ -152,4 +161,66 @@ void SetInterruptHandler(InterruptHandler handler) {
   SetSignalHandler(SIGINT, HandleSIGINT, &prev_sigint_action);
 }
 
+namespace {
+
+ProfileHandler profile_handler;
+timer_t profile_timer;
+bool profile_timer_created = false;
+
+void HandleSIGPROF(int signal, siginfo_t *info, void *context) {
+  assert(signal == SIGPROF);
+  // The timer counts CPU time of the thread that created it, and it's that
+  // thread the signal is sent to.
+  if (profile_handler != nullptr) {
+    profile_handler(Context(context));
+  }
+}
+
+} // namespace
+
+void SetProfileTimer(ProfileHandler handler, unsigned int interval) {
+  if (profile_timer_created) {
+    timer_delete(profile_timer);
+    profile_timer_created = false;
+  }
+  if (interval == 0) {
+    profile_handler = nullptr;
+    return;
+  }
+
+  profile_handler = handler;
+  struct sigaction action;
+  sigemptyset(&action.sa_mask);
+  action.sa_sigaction = HandleSIGPROF;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigaction(SIGPROF, &action, nullptr);
+
+  // Unlike ITIMER_PROF, which counts the CPU time of the whole process and
+  // signals whatever thread happens to be running, this timer only counts
+  // the time of the calling thread and always interrupts it.
+  struct sigevent event;
+  std::memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &profile_timer) != 0) {
+    profile_handler = nullptr;
+    return;
+  }
+  profile_timer_created = true;
+
+  struct itimerspec timer;
+  timer.it_interval.tv_sec = interval / 1000000;
+  timer.it_interval.tv_nsec = (interval % 1000000) * 1000;
+  timer.it_value = timer.it_interval;
+  timer_settime(profile_timer, 0, &timer, nullptr);
+}
+
+void SetCurrentThreadLowPriority() {
+  #ifdef SCHED_IDLE
+    struct sched_param param = {0};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+  #endif
+}
+
 } // namespace os
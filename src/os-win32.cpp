@@ -223,4 +223,64 @@ void SetInterruptHandler(InterruptHandler handler) {
   SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
 }
 
+namespace {
+
+ProfileHandler profile_handler;
+HANDLE profile_thread;
+HANDLE profile_timer_thread;
+HANDLE profile_timer_stop_event;
+DWORD profile_interval;
+
+DWORD WINAPI ProfileTimerThread(LPVOID) {
+  // There are no CPU time timers on Windows, so sample the thread from the
+  // outside while it's suspended.
+  while (WaitForSingleObject(profile_timer_stop_event,
+                             profile_interval) == WAIT_TIMEOUT) {
+    if (SuspendThread(profile_thread) == (DWORD)-1) {
+      continue;
+    }
+    CONTEXT context = {0};
+    context.ContextFlags = CONTEXT_FULL;
+    if (GetThreadContext(profile_thread, &context)) {
+      profile_handler(Context(&context));
+    }
+    ResumeThread(profile_thread);
+  }
+  return 0;
+}
+
+} // namespace
+
+void SetProfileTimer(ProfileHandler handler, unsigned int interval) {
+  if (profile_timer_thread != nullptr) {
+    SetEvent(profile_timer_stop_event);
+    WaitForSingleObject(profile_timer_thread, INFINITE);
+    CloseHandle(profile_timer_thread);
+    CloseHandle(profile_timer_stop_event);
+    CloseHandle(profile_thread);
+    profile_timer_thread = nullptr;
+  }
+  if (interval == 0) {
+    return;
+  }
+
+  profile_handler = handler;
+  // Sleep() and friends have a resolution of 1 ms at best.
+  profile_interval = std::max<DWORD>(interval / 1000, 1);
+  DuplicateHandle(GetCurrentProcess(),
+                  GetCurrentThread(),
+                  GetCurrentProcess(),
+                  &profile_thread,
+                  THREAD_GET_CONTEXT | THREAD_SUSPEND_RESUME,
+                  FALSE,
+                  0);
+  profile_timer_stop_event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+  profile_timer_thread =
+    CreateThread(nullptr, 0, ProfileTimerThread, nullptr, 0, nullptr);
+}
+
+void SetCurrentThreadLowPriority() {
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+}
+
 } // namespace os
@@ -47,6 +47,7 @@ class Context;
 
 typedef void (*CrashHandler)(const Context &context);
 typedef void (*InterruptHandler)(const Context &context);
+typedef void (*ProfileHandler)(const Context &context);
 
 class Context {
  public:
@@ -111,6 +112,13 @@ std::string GetModuleName(void *address);
 void SetCrashHandler(CrashHandler handler);
 void SetInterruptHandler(InterruptHandler handler);
 
+// Interrupts the calling thread about every interval microseconds that it
+// spends running and calls the handler, which must not allocate memory or
+// take locks. An interval of 0 stops the timer.
+void SetProfileTimer(ProfileHandler handler, unsigned int interval);
+
+void SetCurrentThreadLowPriority();
+
 } // namespace os
 
 #endif // !OS_H
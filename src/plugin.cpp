@@ -31,6 +31,7 @@
 #endif
 #include <subhook.h>
 #include "amxpathfinder.h"
+#include "amxsymbolfinder.h"
 #include "crashdetect.h"
 #include "fileutils.h"
 #include "logprintf.h"
@@ -84,24 +85,8 @@ std::string last_opened_amx_file_name;
   }
 #endif
 
-int AMXAPI OnDebugHook(AMX *amx) {
-  return CrashDetect::GetHandler(amx)->OnDebugHook();
-}
-
-int AMXAPI OnCallback(AMX *amx, cell index, cell *result, cell *params) {
-  CrashDetect *handler = CrashDetect::GetHandler(amx);
-  return handler->OnCallback(index, result, params);
-}
-
 int AMXAPI OnExec(AMX *amx, cell *retval, int index) {
-  if (amx->flags & AMX_FLAG_BROWSE) {
-    return amx_Exec(amx, retval, index);
-  }
-  CrashDetect *handler = CrashDetect::GetHandler(amx);
-  if (handler == nullptr) {
-    return amx_Exec(amx, retval, index);
-  }
-  return handler->OnExec(retval, index);
+  return CrashDetect::exec_hook()(amx, retval, index);
 }
 
 int AMXAPI OnExecError(AMX *amx, cell index, cell *retval, int error) {
@@ -167,6 +152,12 @@ PLUGIN_EXPORT bool PLUGIN_CALL Load(void **ppData) {
                    &AMXPathFinder::shared()));
   }
 
+  const std::vector<std::string> &symbol_paths =
+    Options::shared().symbol_paths();
+  for (std::size_t i = 0; i < symbol_paths.size(); i++) {
+    AMXSymbolFinder::shared().AddSearchPath(symbol_paths[i]);
+  }
+
   os::SetCrashHandler(CrashDetect::OnCrash);
   os::SetInterruptHandler(CrashDetect::OnInterrupt);
   CrashDetect::PluginLoad();
@@ -191,8 +182,8 @@ PLUGIN_EXPORT int PLUGIN_CALL AmxLoad(AMX *amx) {
   CrashDetect *handler = CrashDetect::CreateHandler(amx);
   handler->Load();
 
-  amx_SetDebugHook(amx, OnDebugHook);
-  amx_SetCallback(amx, OnCallback);
+  amx_SetDebugHook(amx, handler->debug_hook());
+  amx_SetCallback(amx, CrashDetect::callback());
 
   static AMX_EXT_HOOKS ext_hooks = {
     OnExecError,
@@ -0,0 +1,26 @@
+# Checks that every line of PATTERNS, a regular expression, matches a line of
+# FILE. FILE is removed afterwards so that the next run can't pass by looking
+# at a stale copy.
+#
+# Usage: cmake -DFILE=<file> -DPATTERNS=<file> -P check_file.cmake
+
+if(NOT EXISTS ${FILE})
+  message(FATAL_ERROR "${FILE} does not exist")
+endif()
+
+file(STRINGS ${FILE} _lines)
+file(STRINGS ${PATTERNS} _patterns)
+file(REMOVE ${FILE})
+
+foreach(pattern ${_patterns})
+  set(_found FALSE)
+  foreach(line ${_lines})
+    if(line MATCHES "${pattern}")
+      set(_found TRUE)
+      break()
+    endif()
+  endforeach()
+  if(NOT _found)
+    message(FATAL_ERROR "No line in ${FILE} matches \"${pattern}\"")
+  endif()
+endforeach()
@@ -0,0 +1,46 @@
+# Runs a script that was already run once with debug_info_index enabled,
+# first with the index written by that run and then with a stale one, and
+# checks that the output is the same each time.
+#
+# Usage: cmake -DPLUGIN_RUNNER=<file> -DPLUGIN=<file> -DSCRIPT=<file>
+#              -DOUTPUT=<file> -P debug_info_index.cmake
+
+set(_index ${SCRIPT}.amx.cdidx)
+file(READ ${OUTPUT} _expected_output)
+string(STRIP "${_expected_output}" _expected_output)
+
+macro(run_script)
+  execute_process(COMMAND ${PLUGIN_RUNNER} ${PLUGIN} ${SCRIPT}
+                  OUTPUT_VARIABLE _output
+                  ERROR_VARIABLE _output)
+  if(NOT _output MATCHES "${_expected_output}")
+    message(FATAL_ERROR "Unexpected output:\n${_output}")
+  endif()
+endmacro()
+
+if(NOT EXISTS ${_index})
+  message(FATAL_ERROR "${_index} was not written")
+endif()
+
+# Timestamps have a resolution of one second, so wait a bit for a rewritten
+# index to show up as newer.
+file(TIMESTAMP ${_index} _written "%Y%m%d%H%M%S")
+execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 1)
+
+# The index matches the script, so it must be used as is.
+run_script()
+file(TIMESTAMP ${_index} _reused "%Y%m%d%H%M%S")
+if(NOT _reused STREQUAL _written)
+  message(FATAL_ERROR "${_index} was rewritten although it is up to date")
+endif()
+
+# Changing the script's modification time makes the index stale: it must be
+# rejected and written again.
+execute_process(COMMAND ${CMAKE_COMMAND} -E touch ${SCRIPT}.amx)
+run_script()
+file(TIMESTAMP ${_index} _rewritten "%Y%m%d%H%M%S")
+if(_rewritten STREQUAL _written)
+  message(FATAL_ERROR "Stale ${_index} was not rewritten")
+endif()
+
+file(REMOVE ${_index})
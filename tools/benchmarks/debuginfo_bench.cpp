@@ -0,0 +1,206 @@
+// Copyright (c) 2011-2020 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Compares AMXDebugInfo::GetFunction() with a linear search over the symbol
+// table (which is how it used to work) on a synthetic script with lots of
+// functions and local variables.
+//
+// Usage: debuginfo_bench [num_functions] [locals_per_function]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "amxdebuginfo.h"
+#include "benchmark.h"
+
+namespace {
+
+const cell kFunctionSize = 64 * sizeof(cell);
+const int kNumLookups = 100000;
+
+template<typename T>
+void Append(std::vector<char> &buffer, const T &value) {
+  const char *bytes = reinterpret_cast<const char*>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+void AppendString(std::vector<char> &buffer, const std::string &s) {
+  buffer.insert(buffer.end(), s.c_str(), s.c_str() + s.length() + 1);
+}
+
+// Writes an .amx file that consists of a header, an empty code section and
+// debug info with one line per function and the specified number of local
+// variables in each function.
+bool WriteScript(const std::string &filename,
+                 int num_functions,
+                 int locals_per_function) {
+  cell code_size = num_functions * kFunctionSize;
+
+  AMX_HEADER amxhdr;
+  std::memset(&amxhdr, 0, sizeof(amxhdr));
+  amxhdr.magic = AMX_MAGIC;
+  amxhdr.flags = AMX_FLAG_DEBUG;
+  amxhdr.defsize = sizeof(AMX_FUNCSTUBNT);
+  amxhdr.cod = sizeof(amxhdr);
+  amxhdr.dat = amxhdr.cod + code_size;
+  amxhdr.hea = amxhdr.dat;
+  amxhdr.stp = amxhdr.hea + 4096;
+  amxhdr.size = amxhdr.dat;
+
+  std::vector<char> tables;
+  Append(tables, static_cast<ucell>(0));
+  AppendString(tables, "bench.pwn");
+  for (int i = 0; i < num_functions; i++) {
+    AMX_DBG_LINE line;
+    line.address = i * kFunctionSize;
+    line.line = i + 1;
+    Append(tables, line);
+  }
+  for (int i = 0; i < num_functions; i++) {
+    ucell codestart = i * kFunctionSize;
+    ucell codeend = codestart + kFunctionSize;
+    for (int j = 0; j < locals_per_function; j++) {
+      Append(tables, static_cast<ucell>(-(j + 1) * static_cast<cell>(sizeof(cell))));
+      Append(tables, static_cast<uint16_t>(0));
+      Append(tables, static_cast<ucell>(codestart + 2 * sizeof(cell)));
+      Append(tables, codeend);
+      Append(tables, static_cast<char>(iVARIABLE));
+      Append(tables, static_cast<char>(AMXDebugSymbol::Local));
+      Append(tables, static_cast<uint16_t>(0));
+      AppendString(tables, "local" + std::to_string(j));
+    }
+    Append(tables, codestart);
+    Append(tables, static_cast<uint16_t>(0));
+    Append(tables, codestart);
+    Append(tables, codeend);
+    Append(tables, static_cast<char>(iFUNCTN));
+    Append(tables, static_cast<char>(AMXDebugSymbol::Global));
+    Append(tables, static_cast<uint16_t>(0));
+    AppendString(tables, "function" + std::to_string(i));
+  }
+
+  AMX_DBG_HDR dbghdr;
+  std::memset(&dbghdr, 0, sizeof(dbghdr));
+  dbghdr.size = static_cast<int32_t>(sizeof(dbghdr) + tables.size());
+  dbghdr.magic = AMX_DBG_MAGIC;
+  dbghdr.file_version = 8;
+  dbghdr.amx_version = 8;
+  dbghdr.files = 1;
+  dbghdr.lines = static_cast<uint16_t>(num_functions);
+  dbghdr.symbols =
+    static_cast<uint16_t>(num_functions * (locals_per_function + 1));
+
+  std::FILE *fp = std::fopen(filename.c_str(), "wb");
+  if (fp == nullptr) {
+    return false;
+  }
+  std::vector<char> code(code_size);
+  bool ok = std::fwrite(&amxhdr, sizeof(amxhdr), 1, fp) == 1
+         && std::fwrite(code.data(), 1, code.size(), fp) == code.size()
+         && std::fwrite(&dbghdr, sizeof(dbghdr), 1, fp) == 1
+         && std::fwrite(tables.data(), 1, tables.size(), fp) == tables.size();
+  std::fclose(fp);
+  return ok;
+}
+
+// The old implementation of AMXDebugInfo::GetFunction().
+AMXDebugSymbol LinearGetFunction(const AMXDebugInfo &debug_info,
+                                 cell address) {
+  AMXDebugInfo::SymbolTable symbols = debug_info.GetSymbols();
+  for (AMXDebugInfo::SymbolTable::const_iterator it = symbols.begin();
+       it != symbols.end(); ++it) {
+    if (!it->IsFunction()) {
+      continue;
+    }
+    if (it->GetCodeStart() > address || it->GetCodeEnd() <= address) {
+      continue;
+    }
+    if (it->GetName()[0] == '@') {
+      continue;
+    }
+    return *it;
+  }
+  return AMXDebugSymbol();
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  int num_functions = argc > 1 ? std::atoi(argv[1]) : 8000;
+  int locals_per_function = argc > 2 ? std::atoi(argv[2]) : 7;
+  if (num_functions <= 0
+      || locals_per_function < 0
+      || num_functions * (locals_per_function + 1) > UINT16_MAX) {
+    std::fprintf(stderr, "The symbol table can't have more than %d entries\n",
+                 UINT16_MAX);
+    return EXIT_FAILURE;
+  }
+
+  std::string filename = "debuginfo_bench.amx";
+  if (!WriteScript(filename, num_functions, locals_per_function)) {
+    std::fprintf(stderr, "Could not write %s\n", filename.c_str());
+    return EXIT_FAILURE;
+  }
+  AMXDebugInfo debug_info(filename);
+  std::remove(filename.c_str());
+  if (!debug_info.IsLoaded()) {
+    std::fprintf(stderr, "Could not load debug info\n");
+    return EXIT_FAILURE;
+  }
+
+  std::srand(1);
+  std::vector<cell> addresses(kNumLookups);
+  for (std::size_t i = 0; i < addresses.size(); i++) {
+    addresses[i] = (std::rand() % num_functions) * kFunctionSize
+                 + (std::rand() % (kFunctionSize / sizeof(cell))) * sizeof(cell);
+  }
+
+  // Make sure that both implementations agree before timing them.
+  for (std::size_t i = 0; i < addresses.size(); i++) {
+    if (debug_info.GetFunction(addresses[i]).GetPOD()
+        != LinearGetFunction(debug_info, addresses[i]).GetPOD()) {
+      std::fprintf(stderr, "Results differ at address %08x\n",
+                   static_cast<unsigned>(addresses[i]));
+      return EXIT_FAILURE;
+    }
+  }
+
+  const AMX_DBG_SYMBOL *volatile sink = nullptr;
+  double linear_time = Measure(addresses, [&](cell address) {
+    sink = LinearGetFunction(debug_info, address).GetPOD();
+  });
+  double indexed_time = Measure(addresses, [&](cell address) {
+    sink = debug_info.GetFunction(address).GetPOD();
+  });
+
+  std::printf("%d functions, %d symbols, %d lookups\n",
+              num_functions,
+              num_functions * (locals_per_function + 1),
+              kNumLookups);
+  std::printf("linear search:  %10.1f ns per lookup\n", linear_time);
+  std::printf("function index: %10.1f ns per lookup\n", indexed_time);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2011-2020 Zeex
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Compares the cost of finding the handler of a script, which every hook
+// (natives, publics, the debug hook) does first, using the user data slot
+// (AMXHandler::GetHandler()) and a std::map lookup (how it used to work).
+//
+// Usage: handler_bench [num_scripts...]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include "amxhandler.h"
+#include "benchmark.h"
+
+namespace {
+
+const int kNumLookups = 10000000;
+
+class Handler : public AMXHandler<Handler> {
+ public:
+  Handler(AMX *amx) : AMXHandler<Handler>(amx) {}
+};
+
+void Run(int num_scripts) {
+  std::vector<AMX> scripts(num_scripts);
+  std::map<AMX*, Handler*> handler_map;
+  for (int i = 0; i < num_scripts; i++) {
+    AMX *amx = &scripts[i];
+    std::memset(amx, 0, sizeof(*amx));
+    handler_map[amx] = Handler::CreateHandler(amx);
+  }
+
+  // Scripts are picked at random so that neither variant benefits from
+  // hitting the same one over and over.
+  std::srand(1);
+  std::vector<AMX*> amxs(kNumLookups);
+  for (std::size_t i = 0; i < amxs.size(); i++) {
+    amxs[i] = &scripts[std::rand() % num_scripts];
+  }
+
+  Handler *volatile sink = nullptr;
+  double map_time = Measure(amxs, [&](AMX *amx) {
+    std::map<AMX*, Handler*>::const_iterator it = handler_map.find(amx);
+    sink = it != handler_map.end() ? it->second : nullptr;
+  });
+  double slot_time = Measure(amxs, [&](AMX *amx) {
+    sink = Handler::GetHandler(amx);
+  });
+  std::printf("%8d %10.1f ns %10.1f ns\n", num_scripts, slot_time, map_time);
+
+  for (int i = 0; i < num_scripts; i++) {
+    Handler::DestroyHandler(&scripts[i]);
+  }
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  std::printf("%8s %13s %13s\n", "scripts", "user data", "std::map");
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      int num_scripts = std::atoi(argv[i]);
+      if (num_scripts > 0) {
+        Run(num_scripts);
+      }
+    }
+  } else {
+    Run(1);
+    Run(16);
+    Run(64);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+#!/usr/bin/env python
+#
+# Removes debug info from a compiled script. Keep the original .amx file in
+# one of the crashdetect_symbols directories to still get symbolized output.
+#
+# Usage: strip_debug_info.py input.amx output.amx
+
+import struct
+import sys
+
+AMX_MAGIC = 0xf1e0
+AMX_FLAG_DEBUG = 0x02
+
+if len(sys.argv) != 3:
+  print('Usage: %s input.amx output.amx' % sys.argv[0])
+  sys.exit(1)
+
+with open(sys.argv[1], 'rb') as f:
+  data = bytearray(f.read())
+
+size, magic, file_version, amx_version, flags = \
+  struct.unpack_from('<iHbbh', data, 0)
+if magic != AMX_MAGIC:
+  print('%s is not an AMX file' % sys.argv[1])
+  sys.exit(1)
+
+struct.pack_into('<h', data, 8, flags & ~AMX_FLAG_DEBUG)
+
+with open(sys.argv[2], 'wb') as f:
+  f.write(data[:size])